@@ -8,6 +8,7 @@
 #include <optional>
 #include <map>
 #include <set>
+#include <functional>
 
 using Pair = std::pair<int, int>;
 
@@ -20,6 +21,8 @@ enum Direction
     STAY
 };
 
+// type: 0 vertex, 1 edge, 2 stopping, 3 following, 4 barrier, 5 range, 6 positive
+// (the agent must be at (x, y) at `time`)
 struct Constraint
 {
     int type;
@@ -27,10 +30,16 @@ struct Constraint
     int x;
     int y;
     int time;
+    // Barrier: the straight segment from (x, y) to (x2, y2), blocked at `time`
+    // on (x, y) and one step later on each further cell, up to time_end.
+    // Range: (x, y) is blocked at every step from `time` through time_end.
+    int x2 = 0;
+    int y2 = 0;
+    int time_end = 0;
 
     bool operator<(const Constraint &other) const
     {
-        return std::tie(type, x, y, time) < std::tie(other.type, other.x, other.y, other.time);
+        return std::tie(type, x, y, time, x2, y2, time_end) < std::tie(other.type, other.x, other.y, other.time, other.x2, other.y2, other.time_end);
     }
 };
 
@@ -39,10 +48,12 @@ struct State
     Pair position;
     Direction direction;
     int time_step;
+    int label = 0; // index of the next waypoint to visit
+    int hold = 0;  // remaining dwell steps at the waypoint just reached
 
     bool operator<(const State &other) const
     {
-        return std::tie(position, direction, time_step) < std::tie(other.position, other.direction, other.time_step);
+        return std::tie(position, direction, time_step, label, hold) < std::tie(other.position, other.direction, other.time_step, other.label, other.hold);
     }
 };
 
@@ -52,6 +63,43 @@ std::vector<std::vector<int>> AStarAlgorithm(
     const std::vector<Constraint> &constraints,
     const std::vector<std::vector<int>> &grid);
 
+// Multi-label A*: plans through the ordered waypoints in a single search,
+// holding for `dwell` steps at every intermediate waypoint. The path has the
+// fewest states that the constraints allow; turns only break ties among those.
+std::vector<std::vector<int>> AStarAlgorithm(
+    const Pair &start,
+    const std::vector<Pair> &waypoints,
+    const std::vector<Constraint> &constraints,
+    const std::vector<std::vector<int>> &grid,
+    int dwell = 0);
+
+// Focal A* (the ECBS low level). Searches in timesteps and expands, among
+// states with f <= w * min f, the one whose partial path has the fewest
+// conflicts as counted by `conflicts(from, to, time)`. The returned path
+// has at most w * lower_bound states, where lower_bound receives a lower
+// bound on the number of states of any path that respects the constraints.
+std::vector<std::vector<int>> FocalAStar(
+    const Pair &start,
+    const std::vector<Pair> &waypoints,
+    const std::vector<Constraint> &constraints,
+    const std::vector<std::vector<int>> &grid,
+    int dwell,
+    double w,
+    const std::function<int(const Pair &from, const Pair &to, int time)> &conflicts,
+    int &lower_bound);
+
+// Multi-valued decision diagram: for each timestep, the cells used by at
+// least one constraint-respecting path of `length` states (path.size())
+using Mdd = std::vector<std::vector<Pair>>;
+
+Mdd BuildMdd(
+    const Pair &start,
+    const std::vector<Pair> &waypoints,
+    const std::vector<Constraint> &constraints,
+    const std::vector<std::vector<int>> &grid,
+    int dwell,
+    int length);
+
 std::vector<State> GetNeighbors(
     const State &current,
     const Pair &goal,
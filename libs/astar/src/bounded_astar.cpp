@@ -8,6 +8,7 @@
 #include <map>
 #include <set>
 #include <iostream>
+#include <climits>
 
 int ManhattanDistance(const Pair &a, const Pair &b)
 {
@@ -26,14 +27,16 @@ int RotationCost(Direction from, Direction to)
     return 2;
 }
 
+// Latest stopping constraint on position: the agent may not park there before it
 std::optional<int> GetConstraintTime(const Pair &position, const std::vector<std::vector<int>> &constraints)
 {
+    std::optional<int> latest;
     for (const auto &constraint : constraints)
     {
-        if (position.first == constraint[0] && position.second == constraint[1])
-            return constraint[2];
+        if (position.first == constraint[0] && position.second == constraint[1] && (!latest || constraint[2] > *latest))
+            latest = constraint[2];
     }
-    return std::nullopt;
+    return latest;
 }
 
 std::vector<State> GetNeighbors(
@@ -115,86 +118,432 @@ std::vector<std::vector<int>> AStarAlgorithm(
     const std::vector<Constraint> &constraints,
     const std::vector<std::vector<int>> &grid)
 {
+    return AStarAlgorithm(start, std::vector<Pair>{goal}, constraints, grid, 0);
+}
 
-    std::priority_queue<
-        std::tuple<int, State>,
-        std::vector<std::tuple<int, State>>,
-        std::greater<std::tuple<int, State>>>
-        open_list;
-    open_list.push({0, {start, UP, 0}});
-
-    std::map<State, int> g_costs;
-    g_costs[{start, UP, 0}] = 0;
+// Constraints of one agent, indexed the way GetNeighbors consumes them
+struct ConstraintMaps
+{
+    std::map<int, std::set<Pair>> vertex;
+    std::map<int, std::set<Pair>> edge;
+    std::vector<std::vector<int>> stopping;
+    std::map<int, std::set<Pair>> following;
+    // Positive constraints: the cell the agent must be on at each such time
+    std::map<int, Pair> landmarks;
 
-    std::map<State, State> came_from;
+    // A state must sit on the landmark of its own time and still be able to reach the next one
+    bool ReachesLandmarks(const State &state) const
+    {
+        auto next = landmarks.lower_bound(state.time_step);
+        if (next == landmarks.end())
+            return true;
+        return ManhattanDistance(state.position, next->second) <= next->first - state.time_step;
+    }
 
-    std::map<int, std::set<Pair>> vertex_constraint_map;
-    std::map<int, std::set<Pair>> edge_constraint_map;
-    std::vector<std::vector<int>> stopping_constraint_map;
-    std::map<int, std::set<Pair>> following_constraint_map;
+    // Steps that remain before the last landmark has passed, a lower bound on the cost to go
+    int LandmarkSteps(const State &state) const
+    {
+        return landmarks.empty() ? 0 : std::max(0, landmarks.rbegin()->first - state.time_step);
+    }
 
-    for (const auto &constraint : constraints)
+    explicit ConstraintMaps(const std::vector<Constraint> &constraints)
     {
-        if (constraint.type == 0)
+        for (const auto &constraint : constraints)
         {
-            vertex_constraint_map[constraint.time].insert({constraint.x, constraint.y});
-        }
-        else if (constraint.type == 1)
-        {
-            edge_constraint_map[constraint.time].insert({constraint.x, constraint.y});
-        }
-        else if (constraint.type == 2)
-        {
-            stopping_constraint_map.push_back({constraint.x, constraint.y, constraint.time});
-        }
-        else if (constraint.type == 3)
-        {
-            following_constraint_map[constraint.time].insert({constraint.x, constraint.y});
+            if (constraint.type == 0)
+            {
+                vertex[constraint.time].insert({constraint.x, constraint.y});
+            }
+            else if (constraint.type == 1)
+            {
+                edge[constraint.time].insert({constraint.x, constraint.y});
+            }
+            else if (constraint.type == 2)
+            {
+                stopping.push_back({constraint.x, constraint.y, constraint.time});
+            }
+            else if (constraint.type == 3)
+            {
+                following[constraint.time].insert({constraint.x, constraint.y});
+            }
+            else if (constraint.type == 4)
+            {
+                // A barrier is a run of vertex constraints, one cell further and one step later each
+                int step_x = (constraint.x2 > constraint.x) - (constraint.x2 < constraint.x);
+                int step_y = (constraint.y2 > constraint.y) - (constraint.y2 < constraint.y);
+                for (int k = 0; constraint.time + k <= constraint.time_end; ++k)
+                {
+                    vertex[constraint.time + k].insert({constraint.x + k * step_x, constraint.y + k * step_y});
+                }
+            }
+            else if (constraint.type == 5)
+            {
+                for (int t = constraint.time; t <= constraint.time_end; ++t)
+                {
+                    vertex[t].insert({constraint.x, constraint.y});
+                }
+            }
+            else if (constraint.type == 6)
+            {
+                landmarks[constraint.time] = {constraint.x, constraint.y};
+            }
         }
     }
+};
+
+// Remaining distance along the waypoint chain after reaching waypoint i, plus the dwell steps still owed
+std::vector<int> RemainingChain(const std::vector<Pair> &waypoints, int dwell)
+{
+    std::vector<int> remaining(waypoints.size(), 0);
+    for (int i = (int)waypoints.size() - 2; i >= 0; --i)
+    {
+        remaining[i] = remaining[i + 1] + ManhattanDistance(waypoints[i], waypoints[i + 1]) + dwell;
+    }
+    return remaining;
+}
+
+// Advance the waypoint label when a state lands on the waypoint it is heading for
+void AdvanceLabel(State &state, const std::vector<Pair> &waypoints, int dwell)
+{
+    int last = waypoints.size() - 1;
+    if (state.hold == 0 && state.label < last && state.position == waypoints[state.label])
+    {
+        state.label++;
+        state.hold = dwell;
+    }
+}
+
+std::vector<std::vector<int>> AStarAlgorithm(
+    const Pair &start,
+    const std::vector<Pair> &waypoints,
+    const std::vector<Constraint> &constraints,
+    const std::vector<std::vector<int>> &grid,
+    int dwell)
+{
+    if (waypoints.empty())
+        return {};
+
+    const int last = waypoints.size() - 1;
+    const Pair &goal = waypoints[last];
+
+    ConstraintMaps maps(constraints);
+
+    std::vector<int> remaining = RemainingChain(waypoints, dwell);
+    auto heuristic = [&](const State &state)
+    {
+        return std::max(ManhattanDistance(state.position, waypoints[state.label]) + remaining[state.label] + state.hold, maps.LandmarkSteps(state));
+    };
+
+    State initial_state = {start, UP, 0};
+    AdvanceLabel(initial_state, waypoints, dwell);
+
+    // Path length is the cost, as CBS sums it; among paths of equal length the
+    // one that turns least wins. A state carries its time, so its length is
+    // fixed and only the turns taken to reach it are tracked.
+    std::priority_queue<
+        std::tuple<int, int, State>,
+        std::vector<std::tuple<int, int, State>>,
+        std::greater<std::tuple<int, int, State>>>
+        open_list;
+    open_list.push({heuristic(initial_state), 0, initial_state});
+
+    std::map<State, int> turn_costs;
+    turn_costs[initial_state] = 0;
+
+    std::map<State, State> came_from;
 
     while (!open_list.empty())
     {
-        auto [_, current] = open_list.top();
+        auto [_, turns, current] = open_list.top();
         open_list.pop();
+        if (turns > turn_costs[current])
+            continue;
 
-        if (current.position == goal)
+        // Reaching the goal before the last landmark is only a waypoint on the way there
+        if (current.label == last && current.hold == 0 && current.position == goal && maps.LandmarkSteps(current) == 0)
         {
-            auto constraint_time = GetConstraintTime(current.position, stopping_constraint_map);
-            if (constraint_time.has_value() && current.time_step < constraint_time.value())
+            // Too early to park: the agent may still wait here or come back later
+            auto constraint_time = GetConstraintTime(current.position, maps.stopping);
+            if (!constraint_time.has_value() || current.time_step >= constraint_time.value())
             {
+                std::vector<std::vector<int>> path;
+                while (came_from.find(current) != came_from.end())
+                {
+                    path.push_back({current.position.first, current.position.second, static_cast<int>(current.direction), current.time_step});
+                    current = came_from[current];
+                }
+                path.push_back({start.first, start.second, static_cast<int>(UP), 0});
+                std::reverse(path.begin(), path.end());
+                return path;
+            }
+        }
+
+        for (auto &neighbor : GetNeighbors(current, goal, grid, maps.vertex, maps.edge, maps.stopping, maps.following))
+        {
+            // While dwelling at a waypoint the only legal move is to stay put
+            if (current.hold > 0 && neighbor.position != current.position)
                 continue;
+            if (!maps.ReachesLandmarks(neighbor))
+                continue;
+            neighbor.label = current.label;
+            neighbor.hold = current.hold > 0 ? current.hold - 1 : 0;
+            AdvanceLabel(neighbor, waypoints, dwell);
+
+            if (neighbor.direction == STAY)
+                neighbor.direction = current.direction;
+            int final_turns = turns + RotationCost(current.direction, neighbor.direction);
+            State final_state = neighbor;
+
+            if (turn_costs.find(final_state) == turn_costs.end() || final_turns < turn_costs[final_state])
+            {
+                turn_costs[final_state] = final_turns;
+                int f_cost = final_state.time_step + heuristic(final_state);
+                open_list.push({f_cost, final_turns, final_state});
+                came_from[final_state] = current;
             }
+        }
+    }
+
+    return {};
+}
+std::vector<std::vector<int>> FocalAStar(
+    const Pair &start,
+    const std::vector<Pair> &waypoints,
+    const std::vector<Constraint> &constraints,
+    const std::vector<std::vector<int>> &grid,
+    int dwell,
+    double w,
+    const std::function<int(const Pair &from, const Pair &to, int time)> &conflicts,
+    int &lower_bound)
+{
+    if (waypoints.empty())
+        return {};
 
-            std::vector<std::vector<int>> path;
-            while (came_from.find(current) != came_from.end())
+    const int last = waypoints.size() - 1;
+    const Pair &goal = waypoints[last];
+
+    ConstraintMaps maps(constraints);
+
+    std::vector<int> remaining = RemainingChain(waypoints, dwell);
+    auto heuristic = [&](const State &state)
+    {
+        return std::max(ManhattanDistance(state.position, waypoints[state.label]) + remaining[state.label] + state.hold, maps.LandmarkSteps(state));
+    };
+    auto focal_bound = [w](int f_min)
+    {
+        return static_cast<int>(w * f_min + 1e-9);
+    };
+
+    struct FocalNode
+    {
+        State state;
+        int f;
+        int conflicts;
+        int parent;
+    };
+    std::vector<FocalNode> nodes;
+    // Path length is the cost, so direction does not tell states apart
+    std::map<std::tuple<Pair, int, int, int>, int> seen;
+    auto key = [](const State &state)
+    {
+        return std::make_tuple(state.position, state.time_step, state.label, state.hold);
+    };
+
+    // open holds every unexpanded node by f; focal the ones within the bound, fewest conflicts first
+    std::set<std::pair<int, int>> open;
+    std::set<std::tuple<int, int, int, int>> focal;
+    auto focal_key = [&](int index)
+    {
+        // Deeper nodes first among equals, as they are closer to a goal
+        return std::make_tuple(nodes[index].conflicts, nodes[index].f, -nodes[index].state.time_step, index);
+    };
+
+    State initial_state = {start, UP, 0};
+    AdvanceLabel(initial_state, waypoints, dwell);
+    nodes.push_back({initial_state, heuristic(initial_state), 0, -1});
+    seen[key(initial_state)] = 0;
+    open.insert({nodes[0].f, 0});
+    focal.insert(focal_key(0));
+    int f_min = nodes[0].f;
+
+    while (!focal.empty())
+    {
+        int index = std::get<3>(*focal.begin());
+        focal.erase(focal.begin());
+        open.erase({nodes[index].f, index});
+        State current = nodes[index].state;
+
+        if (current.label == last && current.hold == 0 && current.position == goal && maps.LandmarkSteps(current) == 0)
+        {
+            // Too early to park: the agent may still wait here or come back later
+            auto constraint_time = GetConstraintTime(current.position, maps.stopping);
+            if (!constraint_time.has_value() || current.time_step >= constraint_time.value())
             {
-                path.push_back({current.position.first, current.position.second, static_cast<int>(current.direction), current.time_step});
-                current = came_from[current];
+                lower_bound = f_min + 1;
+                std::vector<std::vector<int>> path;
+                for (int node = index; node != -1; node = nodes[node].parent)
+                {
+                    const State &state = nodes[node].state;
+                    path.push_back({state.position.first, state.position.second, static_cast<int>(state.direction), state.time_step});
+                }
+                path.back()[2] = static_cast<int>(UP);
+                std::reverse(path.begin(), path.end());
+                return path;
             }
-            path.push_back({start.first, start.second, static_cast<int>(UP), 0});
-            std::reverse(path.begin(), path.end());
-            return path;
         }
 
-        for (auto &neighbor : GetNeighbors(current, goal, grid, vertex_constraint_map, edge_constraint_map, stopping_constraint_map, following_constraint_map))
+        for (auto &neighbor : GetNeighbors(current, goal, grid, maps.vertex, maps.edge, maps.stopping, maps.following))
         {
+            if ((current.hold > 0 && neighbor.position != current.position) || !maps.ReachesLandmarks(neighbor))
+                continue;
+            neighbor.label = current.label;
+            neighbor.hold = current.hold > 0 ? current.hold - 1 : 0;
+            AdvanceLabel(neighbor, waypoints, dwell);
             if (neighbor.direction == STAY)
                 neighbor.direction = current.direction;
-            int rotation_cost_value = RotationCost(current.direction, neighbor.direction);
-            int move_cost = (current.position == neighbor.position) ? 1 : 2;
-            int final_g_cost = g_costs[current] + rotation_cost_value + move_cost;
-            State final_state = neighbor;
 
-            if (g_costs.find(final_state) == g_costs.end() || final_g_cost < g_costs[final_state])
+            int neighbor_conflicts = nodes[index].conflicts + conflicts(current.position, neighbor.position, neighbor.time_step);
+            auto found = seen.find(key(neighbor));
+            if (found == seen.end())
             {
-                g_costs[final_state] = final_g_cost;
-                int f_cost = final_g_cost + ManhattanDistance(final_state.position, goal);
-                open_list.push({f_cost, final_state});
-                came_from[final_state] = current;
+                int next = nodes.size();
+                nodes.push_back({neighbor, neighbor.time_step + heuristic(neighbor), neighbor_conflicts, index});
+                seen[key(neighbor)] = next;
+                open.insert({nodes[next].f, next});
+                if (nodes[next].f <= focal_bound(f_min))
+                    focal.insert(focal_key(next));
             }
+            else
+            {
+                // Every path to a state has the same length, so only a less conflicting one replaces it
+                int other = found->second;
+                if (neighbor_conflicts < nodes[other].conflicts && open.count({nodes[other].f, other}))
+                {
+                    bool in_focal = focal.erase(focal_key(other)) > 0;
+                    nodes[other].state = neighbor;
+                    nodes[other].conflicts = neighbor_conflicts;
+                    nodes[other].parent = index;
+                    if (in_focal)
+                        focal.insert(focal_key(other));
+                }
+            }
+        }
+
+        if (open.empty())
+            break;
+
+        // Admit the nodes that a larger minimum f brings within the bound
+        int new_f_min = open.begin()->first;
+        if (new_f_min > f_min)
+        {
+            for (auto it = open.upper_bound({focal_bound(f_min), INT_MAX}); it != open.end() && it->first <= focal_bound(new_f_min); ++it)
+            {
+                focal.insert(focal_key(it->second));
+            }
+            f_min = new_f_min;
         }
     }
 
     return {};
-}
\ No newline at end of file
+}
+
+Mdd BuildMdd(
+    const Pair &start,
+    const std::vector<Pair> &waypoints,
+    const std::vector<Constraint> &constraints,
+    const std::vector<std::vector<int>> &grid,
+    int dwell,
+    int length)
+{
+    if (waypoints.empty() || length <= 0)
+        return {};
+
+    const int last = waypoints.size() - 1;
+    const int horizon = length - 1;
+    const Pair &goal = waypoints[last];
+    std::vector<int> remaining = RemainingChain(waypoints, dwell);
+    ConstraintMaps maps(constraints);
+
+    // Direction only affects cost, never reachability, so MDD nodes are (cell, label, hold)
+    using MddState = std::tuple<Pair, int, int>;
+    auto key = [](const State &state)
+    {
+        return MddState{state.position, state.label, state.hold};
+    };
+    auto steps_to_go = [&](const State &state)
+    {
+        return std::max(ManhattanDistance(state.position, waypoints[state.label]) + remaining[state.label] + state.hold, maps.LandmarkSteps(state));
+    };
+
+    State initial_state = {start, UP, 0};
+    AdvanceLabel(initial_state, waypoints, dwell);
+    if (steps_to_go(initial_state) > horizon)
+        return {};
+
+    // Forward pass: every state reachable at each level that can still make the deadline
+    std::vector<std::map<MddState, std::set<MddState>>> levels(length);
+    levels[0][key(initial_state)];
+    for (int t = 0; t < horizon; ++t)
+    {
+        for (auto &[node, successors] : levels[t])
+        {
+            State current = {std::get<0>(node), UP, t, std::get<1>(node), std::get<2>(node)};
+            for (auto &neighbor : GetNeighbors(current, goal, grid, maps.vertex, maps.edge, maps.stopping, maps.following))
+            {
+                if ((current.hold > 0 && neighbor.position != current.position) || !maps.ReachesLandmarks(neighbor))
+                    continue;
+                neighbor.label = current.label;
+                neighbor.hold = current.hold > 0 ? current.hold - 1 : 0;
+                AdvanceLabel(neighbor, waypoints, dwell);
+
+                if (steps_to_go(neighbor) > horizon - t - 1)
+                    continue;
+                successors.insert(key(neighbor));
+                levels[t + 1][key(neighbor)];
+            }
+        }
+    }
+
+    // The last level keeps only goal states the agent may park on
+    auto constraint_time = GetConstraintTime(goal, maps.stopping);
+    for (auto it = levels[horizon].begin(); it != levels[horizon].end();)
+    {
+        const auto &[position, label, hold] = it->first;
+        bool is_goal = label == last && hold == 0 && position == goal &&
+                       !(constraint_time.has_value() && horizon < constraint_time.value());
+        it = is_goal ? std::next(it) : levels[horizon].erase(it);
+    }
+
+    // Backward pass: drop states with no surviving successor
+    for (int t = horizon - 1; t >= 0; --t)
+    {
+        for (auto it = levels[t].begin(); it != levels[t].end();)
+        {
+            bool alive = false;
+            for (const auto &successor : it->second)
+            {
+                if (levels[t + 1].count(successor))
+                {
+                    alive = true;
+                    break;
+                }
+            }
+            it = alive ? std::next(it) : levels[t].erase(it);
+        }
+    }
+
+    if (levels[0].empty())
+        return {};
+
+    Mdd mdd(length);
+    for (int t = 0; t < length; ++t)
+    {
+        std::set<Pair> cells;
+        for (const auto &level : levels[t])
+        {
+            cells.insert(std::get<0>(level.first));
+        }
+        mdd[t].assign(cells.begin(), cells.end());
+    }
+    return mdd;
+}
@@ -5,30 +5,222 @@
 #include <utility>
 #include <optional>
 #include "bounded_astar.h"
+#include "path_cache.h"
+#include "node_arena.h"
 #include <queue>
+#include <map>
+#include <memory>
+#include <tuple>
+#include <cstdint>
+#include <chrono>
+#include <atomic>
+#include <mutex>
+#include <memory_resource>
 
 using CostPath = std::vector<std::vector<int>>;
 
+enum ConflictType
+{
+    VERTEX_CONFLICT,
+    EDGE_CONFLICT,
+    STOPPING_CONFLICT,
+    FOLLOWING_CONFLICT
+};
+
+// How a conflict's split affects cost: a cardinal conflict raises the cost
+// of both children, a semi-cardinal one of one child, a non-cardinal one of neither
+enum ConflictCardinality
+{
+    NON_CARDINAL,
+    SEMI_CARDINAL,
+    CARDINAL
+};
+
+// High-level heuristics (CBSH): a minimum vertex cover of the conflict graph
+// (cardinal conflicts), of the dependency graph (agent pairs with no
+// conflict-free pair of MDD paths), or a weighted cover of the dependency
+// graph with weights from two-agent sub-solves. They are admissible only
+// while every low-level path is a shortest one, since the MDDs behind them
+// are built at the current path lengths.
+enum CbsHeuristic
+{
+    NO_HEURISTIC,
+    CG_HEURISTIC,
+    DG_HEURISTIC,
+    WDG_HEURISTIC
+};
+
+// A conflict between two agents. agent_1 is the lower index, except for
+// stopping conflicts where it is the agent parked on its goal.
+struct Conflict
+{
+    ConflictType type;
+    int agent_1;
+    int agent_2;
+    int x_1, y_1; // conflict cell; for edge conflicts, agent_1's cell before the swap
+    int x_2, y_2; // agent_2's cell before an edge swap, otherwise the conflict cell
+    int time_1;   // when agent_1 is involved (goal arrival time for stopping conflicts)
+    int time_2;   // when agent_2 is involved
+};
+
+using PathPtr = std::shared_ptr<const CostPath>;
+
+// Hash of a single constraint; summed over a set it gives a canonical fingerprint
+uint64_t ConstraintFingerprint(const Constraint &constraint);
+
+// Node of a persistent constraint tree. A node only records what changed
+// relative to its parent: the constraint added on the way down and the
+// path(s) replanned because of it. Paths are immutable and shared between
+// nodes, so a full solution is rebuilt on demand by walking to the root.
 struct CbsNode
 {
-    std::vector<CostPath> solution;
-    std::vector<Constraint> constraints;
+    // The node's vectors draw from the same memory as the node itself
+    explicit CbsNode(std::pmr::memory_resource *memory = std::pmr::get_default_resource())
+        : paths(memory), path_bounds(memory), conflicts(memory) {}
+
+    std::shared_ptr<const CbsNode> parent;
+    std::optional<Constraint> constraint;
+    // Replanned paths by agent; the root holds one for every agent
+    std::pmr::vector<std::pair<int, PathPtr>> paths;
+    // Lower bounds on the size of each replanned path (bounded-suboptimal search only)
+    std::pmr::vector<std::pair<int, int>> path_bounds;
+    // Every conflict of the solution, kept in ReservationTable::Precedes order
+    std::pmr::vector<Conflict> conflicts;
     int cost;
+    // Lower bound on the cost of any solution below this node (bounded-suboptimal search only)
+    int lower_bound = 0;
+    // Admissible estimate of the cost the remaining conflicts will add
+    int h = 0;
+    int depth = 0;
+    // Order-independent hash of every constraint on the path from the root
+    uint64_t fingerprint = 0;
+    // Meta-agent of every agent, named by its lowest member; null while all agents are single
+    std::shared_ptr<const std::vector<int>> groups;
+    // Agents of the conflict whose split created this node
+    std::pair<int, int> split = {-1, -1};
+    // Set on a child whose meta-agent search ran out of steps: it still holds its
+    // parent's paths and is built again with this many steps once expanded
+    int deferred_steps = 0;
+
+    // Solution view: latest path of one agent, all agents, or the constraints on one agent
+    PathPtr Path(int agent) const;
+    std::vector<PathPtr> Solution(int num_agents) const;
+    std::vector<Constraint> Constraints(int agent) const;
+    int PathBound(int agent) const;
+    // Agents planned jointly with `agent`, itself included
+    std::vector<int> Members(int agent) const;
 
+    // Heap order for best-first search: lower cost + h first, then fewer
+    // conflicts, then shallower nodes. Cost bounds every solution below the
+    // node only because each low-level path is a shortest one.
     bool operator<(const CbsNode &other) const
     {
-        return (cost > other.cost && constraints.size() > other.constraints.size());
+        return std::make_tuple(cost + h, conflicts.size(), depth) > std::make_tuple(other.cost + other.h, other.conflicts.size(), other.depth);
     }
 };
 
+using CbsNodePtr = std::shared_ptr<const CbsNode>;
+
+// Lets another thread stop a running search early
+class CancellationToken
+{
+public:
+    void Cancel() { cancelled = true; }
+    bool Cancelled() const { return cancelled; }
+
+private:
+    std::atomic<bool> cancelled{false};
+};
+
+// Outcome of a deadline-bound search: the best conflict-free solution found
+// in time, or failing that the solution with the fewest conflicts
+struct CbsResult
+{
+    std::vector<CostPath> paths;
+    bool solved = false;
+    int conflicts = 0;
+    int cost = 0;
+    // Lower bound on the optimal cost when the search stopped
+    int lower_bound = 0;
+    // Peak bytes of the constraint tree arena during the solve
+    std::size_t memory_bytes = 0;
+};
+
+// What a search does once its constraint tree reaches Cbs::memory_limit
+enum MemoryLimitPolicy
+{
+    // Stop and report the best result so far, as on a deadline
+    MEMORY_RETURN_BEST,
+    // Drop the open list and finish depth-first from the best open node
+    MEMORY_DEPTH_FIRST
+};
+
 class Cbs
 {
 public:
     explicit Cbs(const std::vector<std::vector<int>> &grid);
 
+    // Steps an agent holds at each intermediate waypoint of its goal sequence
+    int waypoint_dwell = 0;
+    // Split cardinal, then semi-cardinal conflicts first, classified with MDDs (ICBS)
+    bool prioritize_conflicts = true;
+    // Adopt an equal-cost child path with fewer conflicts instead of splitting
+    bool bypass = true;
+    // Lower bound added to the cost when ordering the constraint tree
+    CbsHeuristic heuristic = NO_HEURISTIC;
+    // Expansion budget of each two-agent sub-solve behind a WDG edge weight
+    int pair_search_steps = 64;
+    // Suboptimality factor w: above 1, HighLevel runs focal search at both
+    // levels (ECBS) and returns a solution of cost at most w * optimal
+    double suboptimality = 1.0;
+    // With w > 1, pick nodes by explicit estimation (EECBS), learning the
+    // cost still to come per conflict online
+    bool explicit_estimation = false;
+    // Worker threads expanding the constraint tree in optimal mode; 1 runs the serial search.
+    // Costs match the serial search; speedup has only been measured on one core.
+    int threads = 1;
+    // MA-CBS: merge two (meta-)agents into one, planned jointly, once conflicts
+    // between them have been split this many times on a branch; 0 disables merging
+    int merge_threshold = 0;
+    // Restart the search from a new root after each merge instead of continuing below the node
+    bool merge_restart = false;
+    // Expansion budget of the nested CBS that plans a meta-agent; a child whose
+    // search runs out is kept open and retried with twice the budget
+    int meta_agent_search_steps = 256;
+    // Symmetry reasoning: resolve a rectangle conflict (two agents crossing on
+    // shortest paths) with barrier constraints, and a head-on conflict in a
+    // one-cell-wide corridor with range constraints, in a single split each
+    bool rectangle_reasoning = true;
+    bool corridor_reasoning = true;
+    // Split conflicts into disjoint subtrees with positive and negative constraints
+    bool disjoint_splitting = true;
+    // Low-level results reused across branches and across calls on this instance
+    mutable PathCache path_cache;
+    // k-robust plans: no two agents on one cell within this many steps of each
+    // other, so a plan survives any agent falling up to k steps behind. 1 is the
+    // plain following-conflict model; above it, conflicts split with range
+    // constraints and symmetry reasoning and disjoint splitting are off.
+    int robustness = 1;
+    // Bytes the constraint tree of one solve may take, 0 for no limit. Nodes
+    // come from a per-solve arena; paths live outside it, shared with the path cache.
+    std::size_t memory_limit = 0;
+    // Depth-first applies to the serial optimal search; focal and parallel searches stop
+    MemoryLimitPolicy memory_policy = MEMORY_RETURN_BEST;
+    // Independence Detection: plan every agent alone, then solve only the groups
+    // of agents whose paths conflict, merging groups whose solutions collide
+    bool independence_detection = true;
+
     int FindTotalCost(const std::vector<CostPath> &solution) const;
-    std::vector<std::vector<int>> FindConflicts(const std::vector<CostPath> &solution) const;
-    std::vector<Constraint> GenerateConstraints(const std::vector<std::vector<int>> &conflicts) const;
+    std::vector<Conflict> FindConflicts(const std::vector<CostPath> &solution) const;
+    // Same as FindConflicts(solution)[0], but stops sweeping as soon as that conflict is known
+    std::optional<Conflict> FindFirstConflict(const std::vector<CostPath> &solution) const;
+    // Number of conflicts, without materializing them
+    int CountConflicts(const std::vector<CostPath> &solution) const;
+    std::vector<Constraint> GenerateConstraints(const Conflict &conflict) const;
+    // Disjoint split of a conflict: one agent must be on its conflict cell at
+    // its conflict time (a positive constraint, which keeps every other agent
+    // off that cell) or must not be
+    std::vector<Constraint> DisjointConstraints(const Conflict &conflict) const;
     std::optional<std::vector<CostPath>> LowLevel(
         const std::vector<Pair> &sources,
         const std::vector<Pair> &destinations,
@@ -37,13 +229,151 @@ public:
         const std::vector<Pair> &sources,
         const std::vector<Pair> &destinations, bool pruning = false) const;
 
+    // Goal sequence variants: each agent visits its waypoints in order and parks at the last one
+    std::optional<std::vector<CostPath>> LowLevel(
+        const std::vector<Pair> &sources,
+        const std::vector<std::vector<Pair>> &goal_sequences,
+        const std::vector<Constraint> &constraints) const;
+    std::optional<std::vector<CostPath>> HighLevel(
+        const std::vector<Pair> &sources,
+        const std::vector<std::vector<Pair>> &goal_sequences, bool pruning = false) const;
+
+    // Anytime variants: search until a solution is proven, the budget runs out
+    // or the token is cancelled, with no cap on expansions
+    CbsResult AnytimeHighLevel(
+        const std::vector<Pair> &sources,
+        const std::vector<Pair> &destinations,
+        std::chrono::milliseconds budget,
+        const CancellationToken *cancel = nullptr, bool pruning = false) const;
+    CbsResult AnytimeHighLevel(
+        const std::vector<Pair> &sources,
+        const std::vector<std::vector<Pair>> &goal_sequences,
+        std::chrono::milliseconds budget,
+        const CancellationToken *cancel = nullptr, bool pruning = false) const;
+
+    // Plan a single agent against the constraints that name it
+    std::optional<CostPath> ReplanAgent(
+        int agent,
+        const Pair &source,
+        const std::vector<Pair> &goal_sequence,
+        const std::vector<Constraint> &constraints) const;
+
 private:
     std::vector<std::vector<int>> grid;
-    // Helper functions
-    std::vector<std::vector<int>> FindConflictsEdge(const std::vector<CostPath> &solution) const;
-    std::vector<std::vector<int>> FindConflictsVertex(const std::vector<CostPath> &solution) const;
-    std::vector<std::vector<int>> FindStoppingConflicts(const std::vector<CostPath> &solution) const;
-    std::vector<std::vector<int>> FindConflictsFollow(const std::vector<CostPath> &solution) const;
+
+    // State shared by the helpers of one HighLevel call
+    struct SearchContext
+    {
+        SearchContext(const std::vector<Pair> &sources, const std::vector<std::vector<Pair>> &goal_sequences)
+            : sources(sources), goal_sequences(goal_sequences) {}
+
+        const std::vector<Pair> &sources;
+        const std::vector<std::vector<Pair>> &goal_sequences;
+        // MDDs keyed by (agent, path length, fingerprint of the agent's constraints)
+        std::map<std::tuple<int, int, uint64_t>, std::shared_ptr<const Mdd>> mdds;
+        // DG/WDG edge weights keyed by agent pair and both agents' constraint fingerprints
+        std::map<std::tuple<int, int, uint64_t, uint64_t>, int> pair_weights;
+        // Meta-agent merging; off in nested and parallel searches
+        int merge_threshold = 0;
+        bool merge_restart = false;
+        // A group of Independence Detection, which is not split again
+        bool grouped = false;
+        // Set when a search stops at its expansion budget rather than exhausting its tree
+        bool out_of_steps = false;
+
+        // Anytime searches stop at the deadline or on cancellation
+        std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+        const CancellationToken *cancel = nullptr;
+        bool Expired() const
+        {
+            return (cancel && cancel->Cancelled()) || std::chrono::steady_clock::now() >= deadline ||
+                   (OutOfMemory() && !dive_at_memory_limit);
+        }
+
+        // Arena of the solve's constraint tree; nested searches share it
+        NodeArena *arena = nullptr;
+        bool dive_at_memory_limit = false;
+        bool OutOfMemory() const { return arena && arena->Full(); }
+        std::shared_ptr<CbsNode> NewNode() const
+        {
+            std::pmr::memory_resource *memory = arena ? arena : std::pmr::get_default_resource();
+            return std::allocate_shared<CbsNode>(std::pmr::polymorphic_allocator<CbsNode>(memory), memory);
+        }
+
+        // Best nodes generated so far, for anytime results; may be shared by parallel workers
+        struct Progress
+        {
+            std::mutex mutex;
+            CbsNodePtr incumbent;
+            CbsNodePtr fewest_conflicts;
+            void Record(const CbsNodePtr &node);
+        };
+        Progress *progress = nullptr;
+    };
+
+    // Builds the root and runs the search configured by the members; nullptr if it finds no solution
+    CbsNodePtr Solve(SearchContext &context, bool pruning, int max_steps, int &lower_bound) const;
+    // Independence Detection around Solve: groups are solved in parallel on a
+    // bounded pool and the result is a node holding every agent's path
+    CbsNodePtr SolveIndependent(SearchContext &context, bool pruning, int max_steps, int &lower_bound) const;
+
+    // Root node: every (meta-)agent planned on its own without constraints
+    CbsNodePtr BuildRoot(SearchContext &context, const std::shared_ptr<const std::vector<int>> &groups, CbsHeuristic search_heuristic) const;
+    // Coupled low level: a nested CBS over `agents` alone under their constraints.
+    // Initial paths seed the root where still shortest. Returns the agents' paths, or
+    // nullopt past max_steps, with lower_bound raised to the best bound reached.
+    // out_of_steps, if given, tells a budget miss apart from a proof that the
+    // constraints leave the group no solution.
+    std::optional<std::vector<PathPtr>> SolveGroup(SearchContext &context, const std::vector<int> &agents, const std::vector<std::vector<Constraint>> &constraints, const std::vector<PathPtr> &initial, int max_steps, int &lower_bound, bool *out_of_steps = nullptr) const;
+    // Conflicts split between the meta-agents of agent_1 and agent_2 on the branch to node
+    int BranchConflicts(const CbsNode &node, int agent_1, int agent_2) const;
+    // Child (or, with merge_restart, new root) in which the two agents' meta-agents are one
+    CbsNodePtr Merge(SearchContext &context, const CbsNodePtr &current, const std::vector<PathPtr> &solution, const Conflict &conflict, CbsHeuristic search_heuristic) const;
+
+    // Best-first search below root; returns the first conflict-free node, or
+    // nullptr once max_steps nodes are expanded, setting context.out_of_steps,
+    // or once the tree is exhausted. lower_bound receives the cost + h of the
+    // last node expanded.
+    CbsNodePtr Search(SearchContext &context, const CbsNodePtr &root, bool pruning, CbsHeuristic search_heuristic, int max_steps, int &lower_bound) const;
+    // Search with `threads` workers, each owning a shard of the open list and
+    // stealing the best node of any shard. A solution is returned once no open
+    // or in-flight node has a lower cost + h, so optimality is preserved.
+    CbsNodePtr ParallelSearch(SearchContext &context, const CbsNodePtr &root, bool pruning, int max_steps, int &lower_bound) const;
+    // Children of a node, one per constraint of its chosen conflict. When a
+    // bypass applies there are none and bypassed receives the parent's replacement.
+    // A merge yields a single child, which has no parent after a restart, and a
+    // deferred node yields the child built again in its place.
+    std::vector<CbsNodePtr> Expand(SearchContext &context, const CbsNodePtr &current, CbsHeuristic search_heuristic, CbsNodePtr &bypassed) const;
+    // Child of current that adds constraint, with h left to the caller, or nullptr
+    // if the agents it binds cannot satisfy it. A meta-agent search past
+    // max_steps defers the child.
+    std::shared_ptr<CbsNode> Branch(SearchContext &context, const CbsNodePtr &current, const std::vector<PathPtr> &solution, const Constraint &constraint, std::pair<int, int> split, int max_steps) const;
+    // New paths for the members of one (meta-)agent in the child that adds
+    // constraint; empty if they cannot satisfy it, or with out_of_steps set and
+    // lower_bound raised if a meta-agent search stops at max_steps
+    std::vector<PathPtr> ReplanMembers(SearchContext &context, const CbsNode &node, const std::vector<PathPtr> &solution, const std::vector<int> &members, const Constraint &constraint, int max_steps, int &lower_bound, bool &out_of_steps) const;
+    // Bounded-suboptimal counterpart of Search: ECBS, or EECBS with explicit_estimation
+    CbsNodePtr FocalSearch(SearchContext &context, const CbsNodePtr &root, bool pruning, int max_steps, int &lower_bound) const;
+    // Focal low level: a path within w of the agent's lower bound with few conflicts against the other paths
+    std::optional<CostPath> ReplanAgentFocal(SearchContext &context, int agent, const std::vector<PathPtr> &solution, const std::vector<Constraint> &constraints, int &lower_bound, double w) const;
+
+    std::shared_ptr<const Mdd> GetMdd(SearchContext &context, const CbsNode &node, int agent, int length) const;
+    ConflictCardinality ClassifyConflict(SearchContext &context, const CbsNode &node, const std::vector<PathPtr> &solution, const Conflict &conflict) const;
+    // Index of the conflict to split on: the first cardinal, else semi-cardinal, else the first conflict
+    int ChooseConflict(SearchContext &context, const CbsNode &node, const std::vector<PathPtr> &solution, ConflictCardinality &cardinality) const;
+
+    int ComputeHeuristic(SearchContext &context, const CbsNode &node, const std::vector<PathPtr> &solution, CbsHeuristic search_heuristic) const;
+    // Edge weight between two conflicting agents in the (weighted) dependency graph
+    int PairWeight(SearchContext &context, const CbsNode &node, const std::vector<PathPtr> &solution, int agent_1, int agent_2, CbsHeuristic search_heuristic) const;
+
+    // Barrier constraints for a rectangle conflict, range constraints for a
+    // corridor conflict; empty when the conflict is neither and the usual split applies
+    std::vector<Constraint> SymmetryConstraints(const CbsNode &node, const std::vector<PathPtr> &solution, const Conflict &conflict, ConflictCardinality cardinality) const;
+    std::vector<Constraint> RectangleConstraints(const std::vector<PathPtr> &solution, const Conflict &conflict) const;
+    std::vector<Constraint> CorridorConstraints(const CbsNode &node, const std::vector<PathPtr> &solution, const Conflict &conflict) const;
+
+    // Recompute only the conflicts that involve a replanned agent
+    void UpdateConflicts(std::pmr::vector<Conflict> &conflicts, const std::vector<PathPtr> &solution, int agent) const;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,44 @@
+#ifndef NODE_ARENA_H
+#define NODE_ARENA_H
+
+#include <memory_resource>
+#include <mutex>
+#include <atomic>
+#include <cstddef>
+
+// Monotonic arena for the constraint tree of one solve: nodes and their
+// vectors are carved out of large blocks and released all at once when the
+// arena is destroyed. Safe to share between threads. Tracks the bytes taken
+// from the heap, and reports itself full once they reach the limit.
+class NodeArena : public std::pmr::memory_resource
+{
+public:
+    // A limit of 0 never fills up
+    explicit NodeArena(std::size_t limit = 0);
+
+    // Bytes taken from the heap; never shrinks before the arena is destroyed
+    std::size_t Footprint() const { return upstream.footprint; }
+    bool Full() const { return limit > 0 && Footprint() >= limit; }
+
+private:
+    // Heap blocks for the monotonic buffer, counted on the way
+    struct CountingResource : std::pmr::memory_resource
+    {
+        std::atomic<std::size_t> footprint{0};
+
+        void *do_allocate(std::size_t bytes, std::size_t alignment) override;
+        void do_deallocate(void *p, std::size_t bytes, std::size_t alignment) override;
+        bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override;
+    };
+
+    std::size_t limit;
+    CountingResource upstream;
+    std::mutex mutex;
+    std::pmr::monotonic_buffer_resource buffer;
+
+    void *do_allocate(std::size_t bytes, std::size_t alignment) override;
+    void do_deallocate(void *p, std::size_t bytes, std::size_t alignment) override;
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override;
+};
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef PATH_CACHE_H
+#define PATH_CACHE_H
+
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <mutex>
+#include <atomic>
+#include <optional>
+#include <cstdint>
+#include "bounded_astar.h"
+
+// Memo of single-agent low-level results, keyed by everything the search
+// depends on: the agent, its start, goal sequence and dwell, and the set of
+// its constraints. Safe to share between threads: each lookup locks one of
+// several shards, and a shard evicts its least recently used entries once it
+// holds more than its share of the capacity.
+class PathCache
+{
+public:
+    using Path = std::vector<std::vector<int>>;
+
+    explicit PathCache(size_t capacity = 1 << 14);
+
+    // On a hit, result receives the cached path, or nullopt if the search found none
+    bool Find(int agent, const Pair &start, const std::vector<Pair> &goals, int dwell,
+              const std::vector<Constraint> &constraints, std::optional<Path> &result);
+    void Insert(int agent, const Pair &start, const std::vector<Pair> &goals, int dwell,
+                const std::vector<Constraint> &constraints, const std::optional<Path> &result);
+
+    // Capacity 0 turns the cache off
+    void SetCapacity(size_t capacity);
+    void Clear();
+    size_t Size() const;
+    uint64_t Hits() const { return hits; }
+    uint64_t Misses() const { return misses; }
+
+private:
+    struct Entry
+    {
+        uint64_t hash;
+        int agent;
+        Pair start;
+        std::vector<Pair> goals;
+        int dwell;
+        // Sorted, so that the same set in any order matches
+        std::vector<Constraint> constraints;
+        std::optional<Path> result;
+
+        bool Matches(int agent, const Pair &start, const std::vector<Pair> &goals, int dwell,
+                     const std::vector<Constraint> &sorted) const;
+    };
+
+    struct Shard
+    {
+        mutable std::mutex mutex;
+        // Most recently used first
+        std::list<Entry> entries;
+        std::unordered_multimap<uint64_t, std::list<Entry>::iterator> index;
+    };
+
+    static constexpr int SHARDS = 16;
+    Shard shards[SHARDS];
+    std::atomic<size_t> capacity;
+    std::atomic<uint64_t> hits{0};
+    std::atomic<uint64_t> misses{0};
+
+    static uint64_t Hash(int agent, const Pair &start, const std::vector<Pair> &goals, int dwell,
+                         const std::vector<Constraint> &constraints);
+    static std::vector<Constraint> Sorted(const std::vector<Constraint> &constraints);
+};
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef RESERVATION_TABLE_H
+#define RESERVATION_TABLE_H
+
+#include <vector>
+#include <cstdint>
+#include <optional>
+#include "cbs_alg.h"
+
+// Spatio-temporal index over a solution: every (cell, time) and every cell
+// maps to the agents occupying it, so conflicts are found in one sweep over
+// the paths instead of comparing every pair of agents.
+// With robustness k > 1, two agents on one cell up to k steps apart are a
+// following conflict as well.
+class ReservationTable
+{
+public:
+    explicit ReservationTable(const std::vector<CostPath> &solution, int robustness = 1);
+
+    // All conflicts: vertex, then edge, stopping and following conflicts,
+    // each ordered by (agent_1, agent_2, time) like the pairwise scans
+    std::vector<Conflict> FindConflicts() const;
+    // The first conflict of FindConflicts(), found with early exit
+    std::optional<Conflict> FindFirstConflict() const;
+    int CountConflicts() const;
+
+    // Conflicts between agents i < j by direct comparison of their two paths
+    static void FindPairConflicts(const CostPath &path_1, int i, const CostPath &path_2, int j, std::vector<Conflict> &conflicts, int robustness = 1);
+    // Total order used by FindConflicts: by type, then agents, then time
+    static bool Precedes(const Conflict &a, const Conflict &b);
+
+private:
+    const std::vector<CostPath> &solution;
+    int robustness;
+
+    // Entries are numbered agent by agent: entry offset[i] + t is agent i at time t
+    std::vector<int> offset;
+    std::vector<int> entry_agent;
+
+    // Open-addressing map from a packed key to the first entry of its bucket
+    struct HeadMap
+    {
+        std::vector<uint64_t> keys;
+        std::vector<int> heads;
+        uint64_t mask = 0;
+
+        void Init(int entries);
+        int &Insert(uint64_t key, int entry, bool &inserted);
+        int Find(uint64_t key) const;
+    };
+
+    // Chained buckets: the head map holds a key's latest entry, next links the rest
+    HeadMap cell_time_head;
+    HeadMap cell_head;
+    std::vector<int> cell_time_next;
+    std::vector<int> cell_next;
+
+    static uint64_t CellKey(int x, int y);
+    static uint64_t CellTimeKey(int x, int y, int t);
+
+    // Visits every conflict whose agent_1 is `agent`
+    template <typename Visitor>
+    void VisitConflicts(int agent, Visitor &&visit) const;
+};
+
+#endif
@@ -1,17 +1,47 @@
 #include "cbs_alg.h"
+#include "reservation_table.h"
 #include <map>
 #include <iostream>
 #include <optional>
 #include <queue>
+#include <unordered_set>
+#include <unordered_map>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <climits>
+#include <algorithm>
+#include <iterator>
 #include <set>
+#include <cstdlib>
 
 // Constructor
 Cbs::Cbs(const std::vector<std::vector<int>> &grid) : grid(grid) {}
 
+// Wrap single destinations as one-waypoint goal sequences
+std::vector<std::vector<Pair>> ToGoalSequences(const std::vector<Pair> &destinations)
+{
+    std::vector<std::vector<Pair>> goal_sequences;
+    goal_sequences.reserve(destinations.size());
+    for (const auto &destination : destinations)
+    {
+        goal_sequences.push_back({destination});
+    }
+    return goal_sequences;
+}
+
 std::optional<std::vector<CostPath>> Cbs::LowLevel(
     const std::vector<Pair> &sources,
     const std::vector<Pair> &destinations,
     const std::vector<Constraint> &constraints) const
+{
+    return LowLevel(sources, ToGoalSequences(destinations), constraints);
+}
+
+std::optional<std::vector<CostPath>> Cbs::LowLevel(
+    const std::vector<Pair> &sources,
+    const std::vector<std::vector<Pair>> &goal_sequences,
+    const std::vector<Constraint> &constraints) const
 {
     std::vector<CostPath> solution;
     std::map<int, std::vector<Constraint>> constraint_by_id;
@@ -23,19 +53,90 @@ std::optional<std::vector<CostPath>> Cbs::LowLevel(
 
     for (int i = 0; i < sources.size(); ++i)
     {
-        auto path = AStarAlgorithm(sources[i], destinations[i], constraint_by_id[i], grid);
+        auto path = ReplanAgent(i, sources[i], goal_sequences[i], constraint_by_id[i]);
 
-        if (path.empty())
+        if (!path.has_value())
         {
             // std::cout << "No solution found for Agent " << i << " with constraint." << std::endl;
             return std::nullopt;
         }
-        solution.push_back(path);
+        solution.push_back(std::move(path.value()));
     }
 
     return solution;
 }
 
+std::optional<CostPath> Cbs::ReplanAgent(
+    int agent,
+    const Pair &source,
+    const std::vector<Pair> &goal_sequence,
+    const std::vector<Constraint> &constraints) const
+{
+    std::vector<Constraint> agent_constraints;
+
+    for (const auto &constraint : constraints)
+    {
+        if (constraint.id == agent)
+            agent_constraints.push_back(constraint);
+    }
+
+    std::optional<CostPath> path;
+    if (path_cache.Find(agent, source, goal_sequence, waypoint_dwell, agent_constraints, path))
+        return path;
+
+    auto found = AStarAlgorithm(source, goal_sequence, agent_constraints, grid, waypoint_dwell);
+    if (!found.empty())
+        path = std::move(found);
+
+    path_cache.Insert(agent, source, goal_sequence, waypoint_dwell, agent_constraints, path);
+    return path;
+}
+
+std::optional<CostPath> Cbs::ReplanAgentFocal(SearchContext &context, int agent, const std::vector<PathPtr> &solution, const std::vector<Constraint> &constraints, int &lower_bound, double w) const
+{
+    // Where the other agents are, and from when they stay parked on their goals
+    auto cell_time = [](int x, int y, int t)
+    {
+        return (static_cast<uint64_t>(t) << 40) | (static_cast<uint64_t>(x & 0xFFFFF) << 20) | static_cast<uint64_t>(y & 0xFFFFF);
+    };
+    std::unordered_map<uint64_t, int> occupied;
+    std::map<Pair, int> parked;
+    for (int other = 0; other < solution.size(); ++other)
+    {
+        if (other == agent || !solution[other] || solution[other]->empty())
+            continue;
+        const auto &path = *solution[other];
+        for (int t = 0; t < path.size(); ++t)
+        {
+            occupied[cell_time(path[t][0], path[t][1], t)]++;
+        }
+        parked[{path.back()[0], path.back()[1]}] = path.size();
+    }
+
+    // Vertex conflicts at the arrival time, following conflicts up to k steps either side
+    auto count = [&](const Pair &, const Pair &to, int time)
+    {
+        int total = 0;
+        for (int t = time - robustness; t <= time + robustness; ++t)
+        {
+            auto found = occupied.find(cell_time(to.first, to.second, t));
+            if (found != occupied.end())
+                total += found->second;
+        }
+        auto goal = parked.find(to);
+        if (goal != parked.end() && time + robustness >= goal->second)
+            total++;
+        return total;
+    };
+
+    auto path = FocalAStar(context.sources[agent], context.goal_sequences[agent], constraints, grid, waypoint_dwell, w, count, lower_bound);
+
+    if (path.empty())
+        return std::nullopt;
+
+    return path;
+}
+
 // Calculate the total cost of a solution
 int Cbs::FindTotalCost(const std::vector<CostPath> &solution) const
 {
@@ -49,294 +150,1950 @@ int Cbs::FindTotalCost(const std::vector<CostPath> &solution) const
     return total_cost;
 }
 
-std::vector<std::vector<int>> Cbs::FindConflictsVertex(const std::vector<CostPath> &solution) const
+std::vector<Conflict> Cbs::FindConflicts(const std::vector<CostPath> &solution) const
+{
+    // One sweep over the paths finds all four conflict types
+    return ReservationTable(solution, robustness).FindConflicts();
+}
+
+std::optional<Conflict> Cbs::FindFirstConflict(const std::vector<CostPath> &solution) const
+{
+    return ReservationTable(solution, robustness).FindFirstConflict();
+}
+
+int Cbs::CountConflicts(const std::vector<CostPath> &solution) const
 {
-    std::vector<std::vector<int>> Conflicts;
+    return ReservationTable(solution, robustness).CountConflicts();
+}
+
+void Cbs::UpdateConflicts(std::pmr::vector<Conflict> &conflicts, const std::vector<PathPtr> &solution, int agent) const
+{
+    conflicts.erase(std::remove_if(conflicts.begin(), conflicts.end(), [agent](const Conflict &conflict)
+                                   { return conflict.agent_1 == agent || conflict.agent_2 == agent; }),
+                    conflicts.end());
 
-    for (int i = 0; i < solution.size(); ++i)
+    std::vector<Conflict> agent_conflicts;
+    for (int other = 0; other < solution.size(); ++other)
     {
-        const std::vector<std::vector<int>> &path_1 = solution[i];
+        if (other < agent)
+            ReservationTable::FindPairConflicts(*solution[other], other, *solution[agent], agent, agent_conflicts, robustness);
+        else if (other > agent)
+            ReservationTable::FindPairConflicts(*solution[agent], agent, *solution[other], other, agent_conflicts, robustness);
+    }
+    std::sort(agent_conflicts.begin(), agent_conflicts.end(), ReservationTable::Precedes);
 
-        for (int j = i + 1; j < solution.size(); ++j)
-        {
-            const std::vector<std::vector<int>> &path_2 = solution[j];
+    // Merged on the heap and copied back, so an arena-backed list only grows when it must
+    std::vector<Conflict> merged;
+    merged.reserve(conflicts.size() + agent_conflicts.size());
+    std::merge(conflicts.begin(), conflicts.end(), agent_conflicts.begin(), agent_conflicts.end(),
+               std::back_inserter(merged), ReservationTable::Precedes);
+    conflicts.assign(merged.begin(), merged.end());
+}
 
-            // Check for vertex conflicts
-            for (int t = 0; t < path_1.size() && t < path_2.size(); ++t)
-            {
-                const auto &step_1 = path_1[t];
-                const auto &step_2 = path_2[t];
+static uint64_t SetFingerprint(const std::vector<Constraint> &constraints)
+{
+    uint64_t fingerprint = 0;
+    for (const auto &constraint : constraints)
+    {
+        fingerprint += ConstraintFingerprint(constraint);
+    }
+    return fingerprint;
+}
 
-                if (step_1.size() == 4 && step_2.size() == 4)
-                {
-                    int x1 = step_1[0];
-                    int y1 = step_1[1];
-                    int x2 = step_2[0];
-                    int y2 = step_2[1];
+std::shared_ptr<const Mdd> Cbs::GetMdd(SearchContext &context, const CbsNode &node, int agent, int length) const
+{
+    auto constraints = node.Constraints(agent);
+    auto &mdd = context.mdds[{agent, length, SetFingerprint(constraints)}];
+    if (!mdd)
+        mdd = std::make_shared<const Mdd>(BuildMdd(context.sources[agent], context.goal_sequences[agent], constraints, grid, waypoint_dwell, length));
+    return mdd;
+}
 
-                    if ((x1 == x2 && y1 == y2))
-                    {
-                        Conflicts.push_back({i, j, x1, y1, t});
-                    }
-                }
-            }
-        }
+// True when every path in the MDD is at (x, y) at time t
+static bool IsSingleton(const Mdd &mdd, int t, int x, int y)
+{
+    return t >= 0 && t < mdd.size() && mdd[t].size() == 1 && mdd[t][0] == Pair{x, y};
+}
+
+ConflictCardinality Cbs::ClassifyConflict(SearchContext &context, const CbsNode &node, const std::vector<PathPtr> &solution, const Conflict &conflict) const
+{
+    const Mdd &mdd_1 = *GetMdd(context, node, conflict.agent_1, solution[conflict.agent_1]->size());
+    const Mdd &mdd_2 = *GetMdd(context, node, conflict.agent_2, solution[conflict.agent_2]->size());
+
+    bool cardinal_1 = false;
+    bool cardinal_2 = false;
+    switch (conflict.type)
+    {
+    case VERTEX_CONFLICT:
+        cardinal_1 = IsSingleton(mdd_1, conflict.time_1, conflict.x_1, conflict.y_1);
+        cardinal_2 = IsSingleton(mdd_2, conflict.time_2, conflict.x_1, conflict.y_1);
+        break;
+    case EDGE_CONFLICT:
+        cardinal_1 = IsSingleton(mdd_1, conflict.time_1 - 1, conflict.x_1, conflict.y_1) &&
+                     IsSingleton(mdd_1, conflict.time_1, conflict.x_2, conflict.y_2);
+        cardinal_2 = IsSingleton(mdd_2, conflict.time_2 - 1, conflict.x_2, conflict.y_2) &&
+                     IsSingleton(mdd_2, conflict.time_2, conflict.x_1, conflict.y_1);
+        break;
+    case STOPPING_CONFLICT:
+        // Pushing the parked agent's arrival past the crossing always lengthens its path
+        cardinal_1 = true;
+        cardinal_2 = IsSingleton(mdd_2, conflict.time_2, conflict.x_1, conflict.y_1);
+        break;
+    case FOLLOWING_CONFLICT:
+        cardinal_1 = IsSingleton(mdd_1, conflict.time_1, conflict.x_1, conflict.y_1);
+        cardinal_2 = conflict.time_2 > 0 && IsSingleton(mdd_2, conflict.time_2, conflict.x_1, conflict.y_1);
+        break;
     }
 
-    return Conflicts;
+    if (cardinal_1 && cardinal_2)
+        return CARDINAL;
+    if (cardinal_1 || cardinal_2)
+        return SEMI_CARDINAL;
+    return NON_CARDINAL;
+}
+
+int Cbs::ChooseConflict(SearchContext &context, const CbsNode &node, const std::vector<PathPtr> &solution, ConflictCardinality &cardinality) const
+{
+    cardinality = NON_CARDINAL;
+    if (!prioritize_conflicts)
+        return 0;
+
+    int chosen = 0;
+    for (int i = 0; i < node.conflicts.size(); ++i)
+    {
+        ConflictCardinality current = ClassifyConflict(context, node, solution, node.conflicts[i]);
+        if (current > cardinality)
+        {
+            cardinality = current;
+            chosen = i;
+            if (cardinality == CARDINAL)
+                break;
+        }
+    }
+    return chosen;
 }
 
-std::vector<std::vector<int>> Cbs::FindConflictsEdge(const std::vector<CostPath> &solution) const
+// Whether some pair of paths through the two MDDs avoids every conflict type.
+// Layers are linked by grid adjacency, a superset of the MDDs' own edges, so
+// a false answer still proves that the two agents are dependent.
+static bool HasCompatiblePaths(const Mdd &mdd_1, const Mdd &mdd_2)
 {
-    std::vector<std::vector<int>> conflicts;
+    if (mdd_1.empty() || mdd_2.empty())
+        return true;
+
+    // An agent stays parked on its goal once its MDD ends
+    auto layer = [](const Mdd &mdd, int t) -> const std::vector<Pair> &
+    {
+        return mdd[std::min<int>(t, mdd.size() - 1)];
+    };
+    auto adjacent = [](const Pair &a, const Pair &b)
+    {
+        return std::abs(a.first - b.first) + std::abs(a.second - b.second) <= 1;
+    };
+
+    std::set<std::pair<Pair, Pair>> frontier;
+    for (const auto &cell_1 : mdd_1[0])
+    {
+        for (const auto &cell_2 : mdd_2[0])
+        {
+            if (cell_1 != cell_2)
+                frontier.insert({cell_1, cell_2});
+        }
+    }
 
-    for (int i = 0; i < solution.size(); ++i)
+    const int horizon = std::max(mdd_1.size(), mdd_2.size());
+    for (int t = 1; t < horizon && !frontier.empty(); ++t)
     {
-        const auto &path1 = solution[i];
-        for (int j = i + 1; j < solution.size(); ++j)
+        std::set<std::pair<Pair, Pair>> next;
+        for (const auto &cell_1 : layer(mdd_1, t))
         {
-            const auto &path2 = solution[j];
-            for (int t = 0; t < std::min(path1.size(), path2.size()) - 1; ++t)
+            for (const auto &cell_2 : layer(mdd_2, t))
             {
-                const auto &pos1_t = path1[t];
-                const auto &pos1_t1 = path1[t + 1];
-                const auto &pos2_t = path2[t];
-                const auto &pos2_t1 = path2[t + 1];
-
-                // Check for edge conflicts where agents swap places
-                if ((pos1_t[0] == pos2_t1[0] && pos1_t[1] == pos2_t1[1] &&
-                     pos2_t[0] == pos1_t1[0] && pos2_t[1] == pos1_t1[1]))
+                if (cell_1 == cell_2)
+                    continue;
+                for (const auto &[from_1, from_2] : frontier)
                 {
-                    // Edge conflict detected
-                    conflicts.push_back({i, j, pos1_t[0], pos1_t[1], pos2_t[0], pos2_t[1], t + 1});
+                    // Entering the cell the other agent just left is a following (or edge) conflict
+                    if (adjacent(from_1, cell_1) && adjacent(from_2, cell_2) && cell_1 != from_2 && cell_2 != from_1)
+                    {
+                        next.insert({cell_1, cell_2});
+                        break;
+                    }
                 }
             }
         }
+        frontier = std::move(next);
     }
-
-    return conflicts;
+    return !frontier.empty();
 }
 
-std::vector<std::vector<int>> Cbs::FindStoppingConflicts(const std::vector<CostPath> &solution) const
+// Branch and bound over vertex values for one component of the cover
+static void CoverSearch(int vertex, int sum, std::vector<int> &value, const std::vector<std::vector<int>> &weight, int &best)
 {
-    std::vector<std::vector<int>> stopping_conflicts;
+    if (sum >= best)
+        return;
+    if (vertex == value.size())
+    {
+        best = sum;
+        return;
+    }
+
+    // Edges to assigned vertices fix a minimum; covering every incident edge is the most ever needed
+    int needed = 0;
+    int enough = 0;
+    for (int other = 0; other < value.size(); ++other)
+    {
+        if (other < vertex)
+            needed = std::max(needed, weight[vertex][other] - value[other]);
+        enough = std::max(enough, weight[vertex][other]);
+    }
+    for (int x = needed; x <= enough; ++x)
+    {
+        value[vertex] = x;
+        CoverSearch(vertex + 1, sum + x, value, weight, best);
+    }
+}
 
-    for (int i = 0; i < solution.size(); ++i)
+// Minimum total of vertex values with value[u] + value[v] >= weight for every
+// edge. Components of up to 8 agents are solved exactly; larger ones use the
+// weight of a greedy matching, which is still a lower bound.
+static int MinimumVertexCover(const std::map<std::pair<int, int>, int> &weights)
+{
+    std::map<int, int> root;
+    auto find = [&](int agent)
     {
-        const auto &path1 = solution[i];
-        if (path1.empty())
+        while (root[agent] != agent)
+            agent = root[agent] = root[root[agent]];
+        return agent;
+    };
+    for (const auto &[edge, weight] : weights)
+    {
+        if (weight <= 0)
             continue;
+        root.emplace(edge.first, edge.first);
+        root.emplace(edge.second, edge.second);
+        root[find(edge.first)] = find(edge.second);
+    }
 
-        int goal_x = path1.back()[0];
-        int goal_y = path1.back()[1];
+    std::map<int, std::vector<std::pair<std::pair<int, int>, int>>> components;
+    for (const auto &[edge, weight] : weights)
+    {
+        if (weight > 0)
+            components[find(edge.first)].push_back({edge, weight});
+    }
 
-        for (int j = 0; j < solution.size(); ++j)
+    int cover = 0;
+    for (auto &[component, edges] : components)
+    {
+        std::map<int, int> index;
+        for (const auto &[edge, weight] : edges)
         {
-            if (i == j)
-                continue;
+            index.emplace(edge.first, index.size());
+            index.emplace(edge.second, index.size());
+        }
 
-            const auto &path2 = solution[j];
-            for (int t = path1.size(); t < path2.size(); ++t)
+        if (index.size() <= 8)
+        {
+            std::vector<std::vector<int>> matrix(index.size(), std::vector<int>(index.size(), 0));
+            for (const auto &[edge, weight] : edges)
             {
+                matrix[index[edge.first]][index[edge.second]] = weight;
+                matrix[index[edge.second]][index[edge.first]] = weight;
+            }
 
-                const auto &pos2 = path2[t];
-
-                if (pos2.size() == 4 && pos2[0] == goal_x && pos2[1] == goal_y)
+            // Each vertex covering all of its edges is a feasible starting bound
+            int best = 0;
+            for (const auto &row : matrix)
+            {
+                best += *std::max_element(row.begin(), row.end());
+            }
+            std::vector<int> value(index.size(), 0);
+            CoverSearch(0, 0, value, matrix, best);
+            cover += best;
+        }
+        else
+        {
+            std::sort(edges.begin(), edges.end(), [](const auto &a, const auto &b)
+                      { return a.second > b.second; });
+            std::set<int> matched;
+            for (const auto &[edge, weight] : edges)
+            {
+                if (!matched.count(edge.first) && !matched.count(edge.second))
                 {
-                    stopping_conflicts.push_back({i, j, goal_x, goal_y, t, (int)path1.size() - 1});
+                    matched.insert(edge.first);
+                    matched.insert(edge.second);
+                    cover += weight;
                 }
             }
         }
     }
+    return cover;
+}
+
+int Cbs::PairWeight(SearchContext &context, const CbsNode &node, const std::vector<PathPtr> &solution, int agent_1, int agent_2, CbsHeuristic search_heuristic) const
+{
+    auto constraints_1 = node.Constraints(agent_1);
+    auto constraints_2 = node.Constraints(agent_2);
+    auto key = std::make_tuple(agent_1, agent_2, SetFingerprint(constraints_1), SetFingerprint(constraints_2));
+    auto found = context.pair_weights.find(key);
+    if (found != context.pair_weights.end())
+        return found->second;
+
+    int weight = 0;
+    const Mdd &mdd_1 = *GetMdd(context, node, agent_1, solution[agent_1]->size());
+    const Mdd &mdd_2 = *GetMdd(context, node, agent_2, solution[agent_2]->size());
+    if (!HasCompatiblePaths(mdd_1, mdd_2))
+    {
+        weight = 1;
+        if (search_heuristic == WDG_HEURISTIC)
+        {
+            // Out of budget, the best cost still open bounds the pair's optimum from below
+            int cost = solution[agent_1]->size() + solution[agent_2]->size();
+            int lower_bound = cost;
+            auto paths = SolveGroup(context, {agent_1, agent_2}, {constraints_1, constraints_2}, {solution[agent_1], solution[agent_2]}, pair_search_steps, lower_bound);
+            int pair_cost = paths ? (*paths)[0]->size() + (*paths)[1]->size() : lower_bound;
+            weight = std::max(weight, pair_cost - cost);
+        }
+    }
 
-    return stopping_conflicts;
+    context.pair_weights[key] = weight;
+    return weight;
 }
 
-std::vector<std::vector<int>> Cbs::FindConflictsFollow(const std::vector<std::vector<std::vector<int>>> &solution) const
+int Cbs::ComputeHeuristic(SearchContext &context, const CbsNode &node, const std::vector<PathPtr> &solution, CbsHeuristic search_heuristic) const
 {
-    std::vector<std::vector<int>> Conflicts;
-    int num_paths = solution.size();
+    if (search_heuristic == NO_HEURISTIC || node.conflicts.empty())
+        return 0;
 
-    for (int i = 0; i < num_paths; ++i)
+    // Edge weights between agents that share at least one conflict
+    std::map<std::pair<int, int>, int> weights;
+    for (const auto &conflict : node.conflicts)
     {
-        const auto &path_1 = solution[i];
-        int path_1_size = path_1.size();
-        if (path_1_size == 0)
-            continue;
+        std::pair<int, int> edge = std::minmax(conflict.agent_1, conflict.agent_2);
+        auto found = weights.find(edge);
 
-        for (int j = i + 1; j < num_paths; ++j)
+        if (search_heuristic == CG_HEURISTIC)
         {
-            const auto &path_2 = solution[j];
-            int path_2_size = path_2.size();
-            if (path_2_size == 0)
-                continue;
+            // One cardinal conflict is enough to put the pair in the conflict graph
+            if (found == weights.end() || found->second == 0)
+                weights[edge] = ClassifyConflict(context, node, solution, conflict) == CARDINAL;
+        }
+        else if (found == weights.end())
+        {
+            weights[edge] = PairWeight(context, node, solution, edge.first, edge.second, search_heuristic);
+        }
+    }
+
+    return MinimumVertexCover(weights);
+}
 
-            int min_size = std::min(path_1_size, path_2_size);
+std::optional<std::vector<PathPtr>> Cbs::SolveGroup(SearchContext &context, const std::vector<int> &agents, const std::vector<std::vector<Constraint>> &constraints, const std::vector<PathPtr> &initial, int max_steps, int &lower_bound, bool *out_of_steps) const
+{
+    // The group is renumbered 0..k-1 in the nested search
+    const int size = agents.size();
+    std::vector<Pair> group_sources;
+    std::vector<std::vector<Pair>> group_goals;
+    for (int agent : agents)
+    {
+        group_sources.push_back(context.sources[agent]);
+        group_goals.push_back(context.goal_sequences[agent]);
+    }
+    SearchContext group_context{group_sources, group_goals};
+    group_context.deadline = context.deadline;
+    group_context.cancel = context.cancel;
+    group_context.arena = context.arena;
 
-            for (int t = 0; t < min_size; ++t)
-            {
-                if (t < path_1_size && t > 0 && t - 1 < path_2_size)
-                {
-                    const auto &step_1 = path_1[t];
-                    const auto &step_2_back = path_2[t - 1];
+    // Constraint-only ancestors carry the inherited constraints into the sub-tree
+    CbsNodePtr chain = nullptr;
+    uint64_t fingerprint = 0;
+    std::vector<std::vector<Constraint>> renumbered(size);
+    for (int member = 0; member < size; ++member)
+    {
+        for (auto constraint : constraints[member])
+        {
+            constraint.id = member;
+            renumbered[member].push_back(constraint);
+            auto link = group_context.NewNode();
+            link->parent = chain;
+            link->constraint = constraint;
+            link->cost = 0;
+            fingerprint += ConstraintFingerprint(constraint);
+            link->fingerprint = fingerprint;
+            chain = link;
+        }
+    }
 
-                    if (step_1.size() == 4 && step_2_back.size() == 4)
-                    {
-                        int x1 = step_1[0];
-                        int y1 = step_1[1];
-                        int x2_back = step_2_back[0];
-                        int y2_back = step_2_back[1];
+    auto root = group_context.NewNode();
+    root->parent = chain;
+    root->fingerprint = fingerprint;
+    std::vector<CostPath> root_solution;
+    for (int member = 0; member < size; ++member)
+    {
+        // The nested search is optimal only if every root path is shortest under its
+        // constraints; a joint plan may have detoured a member, so its path is kept only
+        // while it is still as short
+        auto planned = ReplanAgent(member, group_sources[member], group_goals[member], renumbered[member]);
+        if (!planned)
+            return std::nullopt;
+        PathPtr path = member < initial.size() ? initial[member] : nullptr;
+        if (!path || path->size() > planned->size())
+            path = std::make_shared<const CostPath>(std::move(planned.value()));
+        root->paths.emplace_back(member, path);
+        root_solution.push_back(*path);
+    }
+    auto root_conflicts = FindConflicts(root_solution);
+    root->conflicts.assign(root_conflicts.begin(), root_conflicts.end());
+    root->cost = FindTotalCost(root_solution);
 
-                        if (x1 == x2_back && y1 == y2_back)
-                        {
-                            Conflicts.push_back({-1, j, i, x1, y1, t - 1, t});
-                        }
-                    }
-                }
+    auto goal = Search(group_context, root, false, NO_HEURISTIC, max_steps, lower_bound);
+    if (out_of_steps)
+        *out_of_steps = group_context.out_of_steps;
+    if (!goal)
+        return std::nullopt;
+    return goal->Solution(size);
+}
 
-                if (t + 1 < path_2_size)
-                {
-                    const auto &step_1 = path_1[t];
-                    const auto &step_2_fwd = path_2[t + 1];
+CbsNodePtr Cbs::BuildRoot(SearchContext &context, const std::shared_ptr<const std::vector<int>> &groups, CbsHeuristic search_heuristic) const
+{
+    const int num_agents = context.sources.size();
+    auto root = context.NewNode();
+    root->groups = groups;
 
-                    if (step_1.size() == 4 && step_2_fwd.size() == 4)
-                    {
-                        int x1 = step_1[0];
-                        int y1 = step_1[1];
-                        int x2_fwd = step_2_fwd[0];
-                        int y2_fwd = step_2_fwd[1];
+    std::vector<PathPtr> solution(num_agents);
+    for (int agent = 0; agent < num_agents; ++agent)
+    {
+        if (solution[agent])
+            continue;
 
-                        if (x1 == x2_fwd && y1 == y2_fwd)
-                        {
-                            Conflicts.push_back({-1, j, i, x1, y1, t + 1, t});
-                        }
-                    }
-                }
+        auto members = root->Members(agent);
+        if (members.size() == 1)
+        {
+            auto path = ReplanAgent(agent, context.sources[agent], context.goal_sequences[agent], {});
+            if (!path)
+                return nullptr;
+            solution[agent] = std::make_shared<const CostPath>(std::move(path.value()));
+        }
+        else
+        {
+            int lower_bound = 0;
+            auto paths = SolveGroup(context, members, std::vector<std::vector<Constraint>>(members.size()), {}, meta_agent_search_steps, lower_bound);
+            if (!paths)
+                return nullptr;
+            for (int k = 0; k < members.size(); ++k)
+            {
+                solution[members[k]] = (*paths)[k];
             }
         }
     }
 
-    return Conflicts;
+    std::vector<CostPath> paths;
+    for (int agent = 0; agent < num_agents; ++agent)
+    {
+        root->paths.emplace_back(agent, solution[agent]);
+        paths.push_back(*solution[agent]);
+    }
+    auto root_conflicts = FindConflicts(paths);
+    root->conflicts.assign(root_conflicts.begin(), root_conflicts.end());
+    root->cost = FindTotalCost(paths);
+    root->h = ComputeHeuristic(context, *root, solution, search_heuristic);
+    return root;
 }
 
-std::vector<std::vector<int>> Cbs::FindConflicts(const std::vector<CostPath> &solution) const
+int Cbs::BranchConflicts(const CbsNode &node, int agent_1, int agent_2) const
 {
-    // Use a set to automatically handle duplicates
-    std::vector<std::vector<int>> conflicts;
+    auto group = [&](int agent)
+    {
+        return node.groups ? (*node.groups)[agent] : agent;
+    };
+    std::pair<int, int> pair = std::minmax(group(agent_1), group(agent_2));
+
+    int count = 0;
+    for (const CbsNode *ancestor = &node; ancestor; ancestor = ancestor->parent.get())
+    {
+        if (ancestor->split.first < 0)
+            continue;
+        std::pair<int, int> split = std::minmax(group(ancestor->split.first), group(ancestor->split.second));
+        if (split == pair)
+            count++;
+    }
+    return count;
+}
 
-    // Check for vertex conflicts
-    auto vertex_conflicts = FindConflictsVertex(solution);
-    conflicts.insert(conflicts.end(), vertex_conflicts.begin(), vertex_conflicts.end());
+CbsNodePtr Cbs::Merge(SearchContext &context, const CbsNodePtr &current, const std::vector<PathPtr> &solution, const Conflict &conflict, CbsHeuristic search_heuristic) const
+{
+    const int num_agents = solution.size();
+    std::vector<int> groups(num_agents);
+    for (int agent = 0; agent < num_agents; ++agent)
+    {
+        groups[agent] = current->groups ? (*current->groups)[agent] : agent;
+    }
+    int group_1 = groups[conflict.agent_1];
+    int group_2 = groups[conflict.agent_2];
+    for (auto &group : groups)
+    {
+        if (group == group_1 || group == group_2)
+            group = std::min(group_1, group_2);
+    }
+    auto merged = std::make_shared<const std::vector<int>>(std::move(groups));
 
-    // Check for edge conflicts
-    auto edge_conflicts = FindConflictsEdge(solution);
-    conflicts.insert(conflicts.end(), edge_conflicts.begin(), edge_conflicts.end());
+    if (context.merge_restart)
+        return BuildRoot(context, merged, search_heuristic);
 
-    // Check for stopping conflicts
-    auto stopping_conflicts = FindStoppingConflicts(solution);
-    conflicts.insert(conflicts.end(), stopping_conflicts.begin(), stopping_conflicts.end());
+    auto child = context.NewNode();
+    child->parent = current;
+    child->groups = merged;
+    child->depth = current->depth + 1;
+    // A merge changes the node without adding a constraint, so it gets its own fingerprint term
+    child->fingerprint = current->fingerprint + ConstraintFingerprint({-1, std::min(group_1, group_2), std::max(group_1, group_2), 0, 0});
 
-    // Check for following conflicts
-    auto follow_conflicts = FindConflictsFollow(solution);
-    conflicts.insert(conflicts.end(), follow_conflicts.begin(), follow_conflicts.end());
+    auto members = child->Members(conflict.agent_1);
+    std::vector<std::vector<Constraint>> constraints;
+    std::vector<PathPtr> initial;
+    for (int member : members)
+    {
+        constraints.push_back(current->Constraints(member));
+        initial.push_back(solution[member]);
+    }
+    int lower_bound = 0;
+    auto paths = SolveGroup(context, members, constraints, initial, meta_agent_search_steps, lower_bound);
+    if (!paths)
+        return nullptr;
 
-    return conflicts;
+    auto child_solution = solution;
+    child->conflicts = current->conflicts;
+    child->cost = current->cost;
+    for (int k = 0; k < members.size(); ++k)
+    {
+        child->paths.emplace_back(members[k], (*paths)[k]);
+        child->cost += static_cast<int>((*paths)[k]->size()) - static_cast<int>(solution[members[k]]->size());
+        child_solution[members[k]] = (*paths)[k];
+    }
+    for (int member : members)
+    {
+        UpdateConflicts(child->conflicts, child_solution, member);
+    }
+    child->h = ComputeHeuristic(context, *child, child_solution, search_heuristic);
+    return child;
 }
 
-std::vector<Constraint> Cbs::GenerateConstraints(const std::vector<std::vector<int>> &conflicts) const
+// Index of the last state of the leading run of moves that never waits and
+// never reverses direction on either axis
+static int MonotonePrefix(const CostPath &path)
 {
-    // Use a set to avoid duplicate constraints
-    std::vector<Constraint> constraint_set;
-
-    for (const auto &conflict : conflicts)
+    int dx = 0, dy = 0;
+    for (int t = 1; t < path.size(); ++t)
     {
-        if (conflict.size() == 5 && conflict[0] != -1) // Vertex conflict
-        {
-            constraint_set.push_back({0, conflict[0], conflict[2], conflict[3], conflict[4]});
-            constraint_set.push_back({0, conflict[1], conflict[2], conflict[3], conflict[4]});
-        }
-        else if (conflict.size() == 7 && conflict[0] != -1) // Edge conflict
-        {
-            constraint_set.push_back({1, conflict[0], conflict[4], conflict[5], conflict[6]});
-            constraint_set.push_back({1, conflict[1], conflict[2], conflict[3], conflict[6]});
-        }
-        else if (conflict.size() == 6 && conflict[0] != -1) // Stopping conflict
-        {
-            constraint_set.push_back({2, conflict[1], conflict[2], conflict[3], conflict[4]});
-            constraint_set.push_back({2, conflict[0], conflict[2], conflict[3], conflict[4]});
-        }
-        else if (conflict.size() == 7 && conflict[0] == -1) // Following conflict
-        {
-            if (conflict[5] > 0)
-                constraint_set.push_back({3, conflict[1], conflict[3], conflict[4], conflict[5]});
-            constraint_set.push_back({3, conflict[2], conflict[3], conflict[4], conflict[6]});
-        }
+        int step_x = path[t][0] - path[t - 1][0];
+        int step_y = path[t][1] - path[t - 1][1];
+        if (std::abs(step_x) + std::abs(step_y) != 1 || step_x * dx < 0 || step_y * dy < 0)
+            return t - 1;
+        if (step_x)
+            dx = step_x;
+        if (step_y)
+            dy = step_y;
     }
+    return path.size() - 1;
+}
 
-    // Convert the set to a vector
-    std::vector<Constraint> constraints(constraint_set.begin(), constraint_set.end());
+static bool IsFree(const std::vector<std::vector<int>> &grid, int x, int y)
+{
+    return x >= 0 && x < grid.size() && y >= 0 && y < grid[0].size() && grid[x][y] == 1;
+}
 
-    return constraints;
+static std::vector<Pair> FreeNeighbors(const std::vector<std::vector<int>> &grid, const Pair &cell)
+{
+    std::vector<Pair> neighbors;
+    for (auto [dx, dy] : {std::pair<int, int>{1, 0}, {-1, 0}, {0, 1}, {0, -1}})
+    {
+        if (IsFree(grid, cell.first + dx, cell.second + dy))
+            neighbors.push_back({cell.first + dx, cell.second + dy});
+    }
+    return neighbors;
 }
 
-std::optional<std::vector<CostPath>> Cbs::HighLevel(const std::vector<Pair> &sources, const std::vector<Pair> &destinations, bool pruning) const
+// Breadth-first distance from source to target over free cells outside blocked; INT_MAX if unreachable
+static int GridDistance(const std::vector<std::vector<int>> &grid, const Pair &source, const Pair &target, const std::set<Pair> &blocked)
 {
-    std::priority_queue<CbsNode> open;
-    std::set<CbsNode> closed = {};
+    std::map<Pair, int> distance{{source, 0}};
+    std::queue<Pair> frontier;
+    frontier.push(source);
+    while (!frontier.empty())
+    {
+        Pair cell = frontier.front();
+        frontier.pop();
+        if (cell == target)
+            return distance[cell];
+        for (const auto &next : FreeNeighbors(grid, cell))
+        {
+            if ((next == target || !blocked.count(next)) && distance.emplace(next, distance[cell] + 1).second)
+                frontier.push(next);
+        }
+    }
+    return INT_MAX;
+}
 
-    int step = 0;
-    CbsNode root;
-    root.constraints = {};
+std::vector<Constraint> Cbs::RectangleConstraints(const std::vector<PathPtr> &solution, const Conflict &conflict) const
+{
+    if (conflict.type != VERTEX_CONFLICT && conflict.type != FOLLOWING_CONFLICT)
+        return {};
 
-    auto initial_solution = LowLevel(sources, destinations, {});
-    if (!initial_solution)
+    // Both agents must reach the conflict on a shortest path from their starts.
+    // Their arrival times then differ by the same zero or one step on every
+    // cell of the rectangle, so crossing anywhere in it is a conflict.
+    const CostPath *paths[2] = {solution[conflict.agent_1].get(), solution[conflict.agent_2].get()};
+    const int times[2] = {conflict.time_1, conflict.time_2};
+    Pair starts[2], ends[2];
+    for (int i = 0; i < 2; ++i)
     {
-        std::cout << "No initial solution found." << std::endl;
-        return {};
+        int end = MonotonePrefix(*paths[i]);
+        if (times[i] > end)
+            return {};
+        starts[i] = {(*paths[i])[0][0], (*paths[i])[0][1]};
+        ends[i] = {(*paths[i])[end][0], (*paths[i])[end][1]};
     }
 
-    root.solution = *initial_solution;
-    root.cost = FindTotalCost(root.solution);
-    open.push(root);
+    int dx_1 = ends[0].first - starts[0].first, dx_2 = ends[1].first - starts[1].first;
+    int dy_1 = ends[0].second - starts[0].second, dy_2 = ends[1].second - starts[1].second;
+    if (dx_1 * dx_2 < 0 || dy_1 * dy_2 < 0)
+        return {};
+    int sign_x = (dx_1 + dx_2 > 0) - (dx_1 + dx_2 < 0);
+    int sign_y = (dy_1 + dy_2 > 0) - (dy_1 + dy_2 < 0);
+    if (sign_x == 0 || sign_y == 0)
+        return {};
 
-    while (!open.empty())
+    // Mirror the grid so that both agents move towards +u and +w; the mirroring is its own inverse
+    auto mirror = [&](const Pair &cell)
     {
-        step++;
-        if (step > 1000)
-            return std::nullopt;
-        CbsNode current = open.top();
-        open.pop();
+        return Pair{sign_x * cell.first, sign_y * cell.second};
+    };
+    Pair s[2] = {mirror(starts[0]), mirror(starts[1])};
+    Pair g[2] = {mirror(ends[0]), mirror(ends[1])};
+    Pair rect_start{std::max(s[0].first, s[1].first), std::max(s[0].second, s[1].second)};
+    Pair rect_goal{std::min(g[0].first, g[1].first), std::min(g[0].second, g[1].second)};
+    if (rect_start.first >= rect_goal.first || rect_start.second >= rect_goal.second)
+        return {};
 
-        if (pruning && closed.find(current) != closed.end())
-            continue;
-        if(pruning) closed.insert(current);
+    // The agents must cross: one spans the rectangle left to right within its
+    // rows, the other bottom to top within its columns
+    auto crosses = [&](int h, int v)
+    {
+        return s[h].second >= s[v].second && g[h].second <= g[v].second &&
+               s[v].first >= s[h].first && g[v].first <= g[h].first;
+    };
+    int h;
+    if (crosses(0, 1))
+        h = 0;
+    else if (crosses(1, 0))
+        h = 1;
+    else
+        return {};
+    int v = 1 - h;
+    int agents[2] = {conflict.agent_1, conflict.agent_2};
 
-        auto conflicts = FindConflicts(current.solution);
+    // Whichever agent goes second cannot reach its exit border on time
+    auto barrier = [&](int i, const Pair &from, const Pair &to)
+    {
+        int time = (from.first - s[i].first) + (from.second - s[i].second);
+        int length = (to.first - from.first) + (to.second - from.second);
+        Pair first = mirror(from), last = mirror(to);
+        return Constraint{4, agents[i], first.first, first.second, time, last.first, last.second, time + length};
+    };
+    return {barrier(h, {rect_goal.first, rect_start.second}, rect_goal),
+            barrier(v, {rect_start.first, rect_goal.second}, rect_goal)};
+}
 
-        if (conflicts.empty())
+// Earliest time from `time` on at which cell is free of the agent's own vertex and range constraints
+static int EarliestArrival(int time, const Pair &cell, const std::vector<Constraint> &constraints)
+{
+    for (bool moved = true; moved;)
+    {
+        moved = false;
+        for (const auto &constraint : constraints)
         {
-            std::cout << "Solution found with total cost: " << current.cost << std::endl;
-            return current.solution;
+            if (constraint.x != cell.first || constraint.y != cell.second)
+                continue;
+            if ((constraint.type == 0 && constraint.time == time) ||
+                (constraint.type == 5 && constraint.time <= time && time <= constraint.time_end))
+            {
+                time = (constraint.type == 0 ? time : constraint.time_end) + 1;
+                moved = true;
+            }
         }
+    }
+    return time;
+}
 
-        auto conflict = conflicts[0];
+std::vector<Constraint> Cbs::CorridorConstraints(const CbsNode &node, const std::vector<PathPtr> &solution, const Conflict &conflict) const
+{
+    if (conflict.type == STOPPING_CONFLICT)
+        return {};
 
-        std::vector<Constraint> new_constraints = GenerateConstraints({conflict});
+    // The corridor is the chain of free cells with exactly two free neighbours through the conflict
+    Pair cell{conflict.x_1, conflict.y_1};
+    if (FreeNeighbors(grid, cell).size() != 2)
+    {
+        cell = {conflict.x_2, conflict.y_2};
+        if (FreeNeighbors(grid, cell).size() != 2)
+            return {};
+    }
+    std::set<Pair> corridor{cell};
+    Pair ends[2];
+    for (int side = 0; side < 2; ++side)
+    {
+        Pair previous = cell;
+        Pair current = FreeNeighbors(grid, cell)[side];
+        while (FreeNeighbors(grid, current).size() == 2)
+        {
+            // A closed loop has no ends to enter from
+            if (corridor.count(current))
+                return {};
+            corridor.insert(current);
+            auto neighbors = FreeNeighbors(grid, current);
+            Pair next = neighbors[0] == previous ? neighbors[1] : neighbors[0];
+            previous = current;
+            current = next;
+        }
+        ends[side] = previous;
+    }
+    int length = corridor.size() - 1;
+    if (length == 0 || ends[0] == ends[1])
+        return {};
 
-        for (const auto &constraint : new_constraints)
+    // Each agent must cross from one end to the other, in opposite directions,
+    // having entered from outside the corridor
+    int agents[2] = {conflict.agent_1, conflict.agent_2};
+    const int times[2] = {conflict.time_1, conflict.time_2};
+    int entry[2], exit_time[2];
+    for (int i = 0; i < 2; ++i)
+    {
+        const CostPath &path = *solution[agents[i]];
+        auto at = [&](int t)
         {
-            CbsNode child = current;
-            child.constraints.push_back(constraint);
-            auto new_solution = LowLevel(sources, destinations, child.constraints);
+            return Pair{path[t][0], path[t][1]};
+        };
+        int t_conflict = std::min<int>(times[i], path.size() - 1);
+        if (!corridor.count(at(t_conflict)) || (corridor.count(at(0)) && at(0) != ends[0] && at(0) != ends[1]))
+            return {};
 
-            if (!new_solution.has_value())
-                continue;
+        int enter = t_conflict;
+        while (enter > 0 && at(enter) != ends[0] && at(enter) != ends[1])
+            --enter;
+        entry[i] = at(enter) == ends[0] ? 0 : at(enter) == ends[1] ? 1 : -1;
+        if (entry[i] < 0)
+            return {};
 
-            child.solution = new_solution.value();
-            child.cost = FindTotalCost(child.solution);
-            open.push(child);
+        exit_time[i] = -1;
+        for (int t = t_conflict; t < path.size() && exit_time[i] < 0; ++t)
+        {
+            if (at(t) == ends[1 - entry[i]])
+                exit_time[i] = t;
         }
+        if (exit_time[i] < 0)
+            return {};
+    }
+    if (entry[0] == entry[1])
+        return {};
+
+    // Whichever agent goes second reaches its exit only after the first has
+    // crossed, unless it gets there around the corridor
+    std::vector<Constraint> constraints;
+    for (int i = 0; i < 2; ++i)
+    {
+        const Pair start{(*solution[agents[i]])[0][0], (*solution[agents[i]])[0][1]};
+        const Pair other_start{(*solution[agents[1 - i]])[0][0], (*solution[agents[1 - i]])[0][1]};
+        const Pair &exit = ends[1 - entry[i]];
+        // The other agent enters at this exit no sooner than its distance and its
+        // constraints allow and crosses to the far end. Following it, this agent
+        // enters two steps after it leaves and crosses behind it.
+        int other_entered = EarliestArrival(GridDistance(grid, other_start, exit, {}), exit, node.Constraints(agents[1 - i]));
+        int other_crossed = EarliestArrival(other_entered + length, ends[entry[i]], node.Constraints(agents[1 - i]));
+        int around = GridDistance(grid, start, exit, corridor);
+        int last = std::min(other_crossed + length + 1, around == INT_MAX ? INT_MAX : around - 1);
+        int first = GridDistance(grid, start, exit, {});
+
+        // Both children must rule out the current paths
+        if (exit_time[i] < first || exit_time[i] > last)
+            return {};
+        constraints.push_back({5, agents[i], exit.first, exit.second, first, 0, 0, last});
     }
-    std::cout << "No feasible solution found." << std::endl;
-    return {};
-}
\ No newline at end of file
+    return constraints;
+}
+
+std::vector<Constraint> Cbs::SymmetryConstraints(const CbsNode &node, const std::vector<PathPtr> &solution, const Conflict &conflict, ConflictCardinality cardinality) const
+{
+    // Barriers and corridor ranges are sized for conflicts at most one step apart
+    if (robustness > 1)
+        return {};
+
+    // A non-cardinal rectangle has cost-preserving detours, so barriers split it no better than the usual constraints
+    std::vector<Constraint> constraints;
+    if (rectangle_reasoning && cardinality != NON_CARDINAL)
+        constraints = RectangleConstraints(solution, conflict);
+    if (constraints.empty() && corridor_reasoning)
+        constraints = CorridorConstraints(node, solution, conflict);
+    return constraints;
+}
+
+std::vector<Constraint> Cbs::GenerateConstraints(const Conflict &conflict) const
+{
+    std::vector<Constraint> constraints;
+
+    // k-robust: both agents keep off the cell for the same k + 1 steps from the
+    // earlier visit, which every pair of visits within k steps overlaps
+    if (robustness > 1 && (conflict.type == VERTEX_CONFLICT || conflict.type == FOLLOWING_CONFLICT))
+    {
+        int start = std::min(conflict.time_1, conflict.time_2);
+        if (conflict.time_1 > 0)
+            constraints.push_back({5, conflict.agent_1, conflict.x_1, conflict.y_1, start, 0, 0, start + robustness});
+        if (conflict.time_2 > 0)
+            constraints.push_back({5, conflict.agent_2, conflict.x_1, conflict.y_1, start, 0, 0, start + robustness});
+        return constraints;
+    }
+
+    switch (conflict.type)
+    {
+    case VERTEX_CONFLICT:
+        constraints.push_back({0, conflict.agent_1, conflict.x_1, conflict.y_1, conflict.time_1});
+        constraints.push_back({0, conflict.agent_2, conflict.x_1, conflict.y_1, conflict.time_2});
+        break;
+    case EDGE_CONFLICT:
+        constraints.push_back({1, conflict.agent_1, conflict.x_2, conflict.y_2, conflict.time_1});
+        constraints.push_back({1, conflict.agent_2, conflict.x_1, conflict.y_1, conflict.time_2});
+        break;
+    case STOPPING_CONFLICT:
+        // The passing agent avoids the goal at that time; the parked agent arrives later instead
+        constraints.push_back({2, conflict.agent_2, conflict.x_1, conflict.y_1, conflict.time_2});
+        constraints.push_back({2, conflict.agent_1, conflict.x_1, conflict.y_1, conflict.time_2});
+        break;
+    case FOLLOWING_CONFLICT:
+        // An agent cannot be kept off its own start at t = 0; such a child would replan to the same path forever
+        if (conflict.time_2 > 0)
+            constraints.push_back({3, conflict.agent_2, conflict.x_1, conflict.y_1, conflict.time_2});
+        if (conflict.time_1 > 0)
+            constraints.push_back({3, conflict.agent_1, conflict.x_1, conflict.y_1, conflict.time_1});
+        break;
+    }
+
+    return constraints;
+}
+
+// Whether path conflicts with the agent that a positive constraint pins: on
+// its cell one step before, at or after its time, including while parked
+static bool Displaced(const CostPath &path, const Constraint &positive)
+{
+    for (int t = std::max(0, positive.time - 1); t <= positive.time + 1; ++t)
+    {
+        const auto &step = path[std::min<int>(t, path.size() - 1)];
+        if (step[0] == positive.x && step[1] == positive.y)
+            return true;
+    }
+    return false;
+}
+
+// What another agent's positive constraint forbids this agent: its cell one step
+// before and at its time, and parking on it or entering it one step after
+static std::vector<Constraint> ImpliedConstraints(const Constraint &positive, int agent)
+{
+    return {{0, agent, positive.x, positive.y, positive.time - 1},
+            {0, agent, positive.x, positive.y, positive.time},
+            {2, agent, positive.x, positive.y, positive.time + 1}};
+}
+
+std::vector<Constraint> Cbs::DisjointConstraints(const Conflict &conflict) const
+{
+    // A parked agent cannot be pinned to its goal by the low level, so stopping conflicts split as usual.
+    // A positive constraint keeps others off its cell for one step either side only, too little when k > 1.
+    if (conflict.type == STOPPING_CONFLICT || robustness > 1)
+        return GenerateConstraints(conflict);
+
+    // Each agent is on a conflict cell at its conflict time: agent_1 ends an edge conflict on (x_2, y_2)
+    struct Choice
+    {
+        int agent, x, y, time;
+    };
+    Choice choices[2] = {{conflict.agent_1, conflict.x_1, conflict.y_1, conflict.time_1},
+                         {conflict.agent_2, conflict.x_2, conflict.y_2, conflict.time_2}};
+    if (conflict.type == EDGE_CONFLICT)
+    {
+        std::swap(choices[0].x, choices[1].x);
+        std::swap(choices[0].y, choices[1].y);
+    }
+
+    // An agent cannot be kept off its start at t = 0
+    for (const auto &choice : choices)
+    {
+        if (choice.time > 0)
+            return {{6, choice.agent, choice.x, choice.y, choice.time},
+                    {0, choice.agent, choice.x, choice.y, choice.time}};
+    }
+    return GenerateConstraints(conflict);
+}
+
+std::optional<std::vector<CostPath>> Cbs::HighLevel(const std::vector<Pair> &sources, const std::vector<Pair> &destinations, bool pruning) const
+{
+    return HighLevel(sources, ToGoalSequences(destinations), pruning);
+}
+
+std::optional<std::vector<CostPath>> Cbs::HighLevel(const std::vector<Pair> &sources, const std::vector<std::vector<Pair>> &goal_sequences, bool pruning) const
+{
+    NodeArena arena(memory_limit);
+    SearchContext context{sources, goal_sequences};
+    context.arena = &arena;
+    int lower_bound = 0;
+    auto goal = Solve(context, pruning, 1000, lower_bound);
+    if (!goal)
+    {
+        std::cout << "No feasible solution found." << std::endl;
+        return {};
+    }
+
+    std::cout << "Solution found with total cost: " << goal->cost << std::endl;
+    std::vector<CostPath> paths;
+    for (const auto &path : goal->Solution(sources.size()))
+    {
+        paths.push_back(*path);
+    }
+    return paths;
+}
+
+CbsResult Cbs::AnytimeHighLevel(const std::vector<Pair> &sources, const std::vector<Pair> &destinations, std::chrono::milliseconds budget, const CancellationToken *cancel, bool pruning) const
+{
+    return AnytimeHighLevel(sources, ToGoalSequences(destinations), budget, cancel, pruning);
+}
+
+CbsResult Cbs::AnytimeHighLevel(const std::vector<Pair> &sources, const std::vector<std::vector<Pair>> &goal_sequences, std::chrono::milliseconds budget, const CancellationToken *cancel, bool pruning) const
+{
+    // Declared first so that it outlives every node the search hands out
+    NodeArena arena(memory_limit);
+    SearchContext::Progress progress;
+    SearchContext context{sources, goal_sequences};
+    context.deadline = std::chrono::steady_clock::now() + budget;
+    context.cancel = cancel;
+    context.arena = &arena;
+    context.progress = &progress;
+
+    int lower_bound = 0;
+    auto goal = Solve(context, pruning, INT_MAX, lower_bound);
+
+    // Out of time, fall back to the best solution generated, then to the least conflicting one
+    CbsNodePtr best = goal ? goal : progress.incumbent ? progress.incumbent : progress.fewest_conflicts;
+    CbsResult result;
+    result.memory_bytes = arena.Footprint();
+    if (!best)
+        return result;
+
+    for (const auto &path : best->Solution(sources.size()))
+    {
+        result.paths.push_back(*path);
+    }
+    result.solved = best->conflicts.empty();
+    result.conflicts = best->conflicts.size();
+    result.cost = best->cost;
+    result.lower_bound = std::min(lower_bound, best->cost);
+    return result;
+}
+
+void Cbs::SearchContext::Progress::Record(const CbsNodePtr &node)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (node->conflicts.empty() && (!incumbent || node->cost < incumbent->cost))
+        incumbent = node;
+    if (!fewest_conflicts || std::make_pair(node->conflicts.size(), node->cost) < std::make_pair(fewest_conflicts->conflicts.size(), fewest_conflicts->cost))
+        fewest_conflicts = node;
+}
+
+CbsNodePtr Cbs::Solve(SearchContext &context, bool pruning, int max_steps, int &lower_bound) const
+{
+    const int num_agents = context.sources.size();
+
+    if (independence_detection && !context.grouped && num_agents > 1)
+        return SolveIndependent(context, pruning, max_steps, lower_bound);
+
+    if (suboptimality > 1.0)
+    {
+        // Agents are planned in turn, each steering clear of the paths already chosen
+        auto root = context.NewNode();
+        std::vector<PathPtr> planned(num_agents);
+        std::vector<CostPath> initial_solution;
+        for (int i = 0; i < num_agents; ++i)
+        {
+            int bound;
+            auto path = ReplanAgentFocal(context, i, planned, {}, bound, suboptimality);
+            if (!path)
+            {
+                std::cout << "No initial solution found." << std::endl;
+                return nullptr;
+            }
+            planned[i] = std::make_shared<const CostPath>(std::move(path.value()));
+            initial_solution.push_back(*planned[i]);
+            root->paths.emplace_back(i, planned[i]);
+            root->path_bounds.emplace_back(i, bound);
+            root->lower_bound += bound;
+        }
+        auto root_conflicts = FindConflicts(initial_solution);
+        root->conflicts.assign(root_conflicts.begin(), root_conflicts.end());
+        root->cost = FindTotalCost(initial_solution);
+        if (context.progress)
+            context.progress->Record(root);
+
+        return FocalSearch(context, root, pruning, max_steps, lower_bound);
+    }
+
+    context.merge_threshold = merge_threshold;
+    context.merge_restart = merge_restart;
+
+    auto root = BuildRoot(context, nullptr, heuristic);
+    if (!root)
+    {
+        std::cout << "No initial solution found." << std::endl;
+        return nullptr;
+    }
+    if (context.progress)
+        context.progress->Record(root);
+
+    if (threads > 1)
+        return ParallelSearch(context, root, pruning, max_steps, lower_bound);
+    context.dive_at_memory_limit = memory_policy == MEMORY_DEPTH_FIRST;
+    return Search(context, root, pruning, heuristic, max_steps, lower_bound);
+}
+
+CbsNodePtr Cbs::SolveIndependent(SearchContext &context, bool pruning, int max_steps, int &lower_bound) const
+{
+    const int num_agents = context.sources.size();
+
+    // Every agent starts in a group of its own, on an optimal path that avoids
+    // the agents planned before it where it can
+    std::vector<int> group(num_agents);
+    std::vector<PathPtr> solution(num_agents);
+    std::vector<int> group_bounds(num_agents, 0);
+    for (int i = 0; i < num_agents; ++i)
+    {
+        auto path = ReplanAgentFocal(context, i, solution, {}, group_bounds[i], 1.0);
+        if (!path)
+        {
+            std::cout << "No initial solution found." << std::endl;
+            return nullptr;
+        }
+        group[i] = i;
+        solution[i] = std::make_shared<const CostPath>(std::move(path.value()));
+    }
+
+    auto assemble = [&]()
+    {
+        auto node = context.NewNode();
+        std::vector<CostPath> paths;
+        for (int i = 0; i < num_agents; ++i)
+        {
+            node->paths.emplace_back(i, solution[i]);
+            paths.push_back(*solution[i]);
+        }
+        auto node_conflicts = FindConflicts(paths);
+        node->conflicts.assign(node_conflicts.begin(), node_conflicts.end());
+        node->cost = FindTotalCost(paths);
+        return node;
+    };
+    auto total_bound = [&]()
+    {
+        int bound = 0;
+        for (int i = 0; i < num_agents; ++i)
+        {
+            if (group[i] == i)
+                bound += group_bounds[i];
+        }
+        return bound;
+    };
+
+    while (true)
+    {
+        auto node = assemble();
+        node->lower_bound = total_bound();
+        if (context.progress)
+            context.progress->Record(node);
+        if (node->conflicts.empty())
+        {
+            lower_bound = node->lower_bound;
+            return node;
+        }
+
+        // Before merging, a conflicting agent that is still alone tries another
+        // optimal path around everyone else
+        std::set<int> alone;
+        for (const auto &conflict : node->conflicts)
+        {
+            for (int agent : {conflict.agent_1, conflict.agent_2})
+            {
+                if (group[agent] == agent && std::count(group.begin(), group.end(), agent) == 1)
+                    alone.insert(agent);
+            }
+        }
+        for (int agent : alone)
+        {
+            int bound;
+            auto path = ReplanAgentFocal(context, agent, solution, {}, bound, 1.0);
+            if (path)
+                solution[agent] = std::make_shared<const CostPath>(std::move(path.value()));
+        }
+        if (!alone.empty())
+        {
+            node = assemble();
+            node->lower_bound = total_bound();
+            if (node->conflicts.empty())
+            {
+                if (context.progress)
+                    context.progress->Record(node);
+                lower_bound = node->lower_bound;
+                return node;
+            }
+        }
+
+        // Merge the groups of every conflicting pair; a group is named by its lowest member
+        std::set<int> merged;
+        for (const auto &conflict : node->conflicts)
+        {
+            int group_1 = group[conflict.agent_1];
+            int group_2 = group[conflict.agent_2];
+            if (group_1 == group_2)
+                continue;
+            int low = std::min(group_1, group_2);
+            int high = std::max(group_1, group_2);
+            for (int &name : group)
+            {
+                if (name == high)
+                    name = low;
+            }
+            merged.erase(high);
+            merged.insert(low);
+        }
+
+        // Only the merged groups are solved again, each in a search of its own
+        std::vector<std::vector<int>> members;
+        for (int name : merged)
+        {
+            members.emplace_back();
+            for (int i = 0; i < num_agents; ++i)
+            {
+                if (group[i] == name)
+                    members.back().push_back(i);
+            }
+        }
+
+        const int num_groups = members.size();
+        std::vector<CbsNodePtr> results(num_groups);
+        std::vector<int> bounds(num_groups, 0);
+        std::vector<SearchContext::Progress> progress(num_groups);
+        auto solve = [&](int g)
+        {
+            std::vector<Pair> group_sources;
+            std::vector<std::vector<Pair>> group_goals;
+            for (int agent : members[g])
+            {
+                group_sources.push_back(context.sources[agent]);
+                group_goals.push_back(context.goal_sequences[agent]);
+            }
+            SearchContext group_context{group_sources, group_goals};
+            group_context.deadline = context.deadline;
+            group_context.cancel = context.cancel;
+            group_context.arena = context.arena;
+            group_context.grouped = true;
+            group_context.progress = &progress[g];
+            results[g] = Solve(group_context, pruning, max_steps, bounds[g]);
+        };
+
+        // Groups go to a pool of workers, each taking the next unsolved group. A group
+        // search may itself run `threads` workers, so the pool shrinks to match and
+        // together they use about one thread per core.
+        const int cores = std::max(1u, std::thread::hardware_concurrency());
+        const int pool = std::max(1, std::min(num_groups, cores / std::max(1, threads)));
+        std::atomic<int> next_group{0};
+        auto work = [&]()
+        {
+            for (int g = next_group++; g < num_groups; g = next_group++)
+                solve(g);
+        };
+
+        std::vector<std::thread> workers;
+        for (int worker = 1; worker < pool; ++worker)
+            workers.emplace_back(work);
+        work();
+        for (auto &worker : workers)
+            worker.join();
+
+        bool solved = true;
+        for (int g = 0; g < num_groups; ++g)
+        {
+            group_bounds[members[g].front()] = bounds[g];
+
+            // A group out of budget contributes its best partial solution, if any
+            auto best = results[g] ? results[g] : progress[g].incumbent ? progress[g].incumbent : progress[g].fewest_conflicts;
+            solved = solved && results[g];
+            if (!best)
+                continue;
+            auto paths = best->Solution(members[g].size());
+            for (int m = 0; m < members[g].size(); ++m)
+                solution[members[g][m]] = paths[m];
+        }
+
+        if (!solved)
+        {
+            auto partial = assemble();
+            partial->lower_bound = total_bound();
+            if (context.progress)
+                context.progress->Record(partial);
+            lower_bound = partial->lower_bound;
+            return nullptr;
+        }
+    }
+}
+
+CbsNodePtr Cbs::Search(SearchContext &context, const CbsNodePtr &root, bool pruning, CbsHeuristic search_heuristic, int max_steps, int &lower_bound) const
+{
+    auto compare = [](const CbsNodePtr &a, const CbsNodePtr &b)
+    {
+        return *a < *b;
+    };
+    std::priority_queue<CbsNodePtr, std::vector<CbsNodePtr>, decltype(compare)> open(compare);
+    // Nodes with the same constraint set have the same solution, so expand each set once
+    std::unordered_set<uint64_t> closed;
+
+    int step = 0;
+    open.push(root);
+
+    // A bypass replaces the node being expanded, so it is expanded next without a trip through the open list
+    CbsNodePtr bypassed = nullptr;
+
+    // Past the memory limit, the open list gives way to a depth-first stack
+    // seeded with the best open node, most promising child on top
+    bool diving = false;
+    std::vector<CbsNodePtr> stack;
+
+    while (!open.empty() || !stack.empty() || bypassed)
+    {
+        step++;
+        if (step > max_steps || context.Expired())
+        {
+            context.out_of_steps = step > max_steps;
+            return nullptr;
+        }
+
+        if (!diving && context.OutOfMemory())
+        {
+            diving = true;
+            if (!open.empty())
+                stack.push_back(open.top());
+            while (!open.empty())
+                open.pop();
+        }
+
+        CbsNodePtr current;
+        if (bypassed)
+        {
+            current = std::move(bypassed);
+            bypassed = nullptr;
+        }
+        else
+        {
+            if (diving)
+            {
+                if (stack.empty())
+                    return nullptr;
+                current = stack.back();
+                stack.pop_back();
+            }
+            else
+            {
+                current = open.top();
+                open.pop();
+            }
+
+            // A deferred node shares its fingerprint with the child built in its place
+            if (pruning && !current->deferred_steps && !closed.insert(current->fingerprint).second)
+                continue;
+        }
+        // Depth-first nodes no longer come in cost order
+        if (!diving)
+            lower_bound = std::max(lower_bound, current->cost + current->h);
+
+        // Conflicts are inherited and patched per replan, so they are already at hand.
+        // Nodes come off open by cost + h, so outside a dive the first conflict-free
+        // one is optimal.
+        if (current->conflicts.empty())
+            return current;
+
+        auto children = Expand(context, current, search_heuristic, bypassed);
+        if (context.progress)
+        {
+            for (const auto &child : children)
+            {
+                context.progress->Record(child);
+            }
+            if (bypassed)
+                context.progress->Record(bypassed);
+        }
+
+        // A merge with restart hands back a new root; the old tree is dropped
+        if (children.size() == 1 && !children[0]->parent)
+        {
+            while (!open.empty())
+                open.pop();
+            stack.clear();
+            closed.clear();
+        }
+        if (diving)
+        {
+            // Fewest conflicts, then lowest cost, is expanded next
+            std::sort(children.begin(), children.end(), [](const CbsNodePtr &a, const CbsNodePtr &b)
+                      { return std::make_pair(a->conflicts.size(), a->cost) > std::make_pair(b->conflicts.size(), b->cost); });
+            stack.insert(stack.end(), children.begin(), children.end());
+            continue;
+        }
+        for (auto &child : children)
+        {
+            open.push(child);
+        }
+    }
+    return nullptr;
+}
+
+CbsNodePtr Cbs::ParallelSearch(SearchContext &context, const CbsNodePtr &root, bool pruning, int max_steps, int &lower_bound) const
+{
+    struct Compare
+    {
+        bool operator()(const CbsNodePtr &a, const CbsNodePtr &b) const
+        {
+            return *a < *b;
+        }
+    };
+    using OpenList = std::priority_queue<CbsNodePtr, std::vector<CbsNodePtr>, Compare>;
+    struct Shard
+    {
+        std::mutex mutex;
+        OpenList open;
+    };
+    std::vector<Shard> shards(threads);
+    shards[0].open.push(root);
+
+    // Nodes in any shard or being expanded; the search is over when none remain
+    std::atomic<int> pending{1};
+    std::atomic<int> steps{0};
+    std::atomic<bool> aborted{false};
+
+    // Best conflict-free node so far; nodes that cannot beat it are dropped
+    std::mutex incumbent_mutex;
+    CbsNodePtr incumbent = nullptr;
+    std::atomic<int> incumbent_cost{INT_MAX};
+
+    std::mutex closed_mutex;
+    std::unordered_set<uint64_t> closed;
+
+    // Pop the best top over all shards; on ties the worker's own shard wins
+    auto take = [&](int worker) -> CbsNodePtr
+    {
+        int best = -1;
+        CbsNodePtr best_node = nullptr;
+        for (int k = 0; k < threads; ++k)
+        {
+            int shard = (worker + k) % threads;
+            std::lock_guard<std::mutex> lock(shards[shard].mutex);
+            if (!shards[shard].open.empty() && (!best_node || *best_node < *shards[shard].open.top()))
+            {
+                best = shard;
+                best_node = shards[shard].open.top();
+            }
+        }
+        if (best == -1)
+            return nullptr;
+
+        std::lock_guard<std::mutex> lock(shards[best].mutex);
+        if (shards[best].open.empty())
+            return nullptr;
+        auto node = shards[best].open.top();
+        shards[best].open.pop();
+        return node;
+    };
+
+    auto work = [&](int worker)
+    {
+        // MDD and pair-weight caches are per worker, so helpers never share mutable state
+        SearchContext worker_context{context.sources, context.goal_sequences};
+        worker_context.deadline = context.deadline;
+        worker_context.cancel = context.cancel;
+        worker_context.arena = context.arena;
+        worker_context.progress = context.progress;
+
+        while (pending > 0 && !aborted)
+        {
+            if (worker_context.Expired())
+            {
+                aborted = true;
+                break;
+            }
+
+            CbsNodePtr current = take(worker);
+            if (!current)
+            {
+                std::this_thread::yield();
+                continue;
+            }
+
+            // Expand the node, then whatever bypasses replace it
+            bool from_open = true;
+            while (current)
+            {
+                if (current->cost + current->h >= incumbent_cost)
+                    break;
+                if (pruning && from_open && !current->deferred_steps)
+                {
+                    std::lock_guard<std::mutex> lock(closed_mutex);
+                    if (!closed.insert(current->fingerprint).second)
+                        break;
+                }
+                if (++steps > max_steps)
+                {
+                    // Back in a shard, the node still counts towards the lower bound
+                    std::lock_guard<std::mutex> lock(shards[worker].mutex);
+                    shards[worker].open.push(current);
+                    aborted = true;
+                    break;
+                }
+
+                if (current->conflicts.empty())
+                {
+                    std::lock_guard<std::mutex> lock(incumbent_mutex);
+                    if (current->cost < incumbent_cost)
+                    {
+                        incumbent = current;
+                        incumbent_cost = current->cost;
+                    }
+                    break;
+                }
+
+                CbsNodePtr bypassed = nullptr;
+                auto children = Expand(worker_context, current, heuristic, bypassed);
+                if (worker_context.progress)
+                {
+                    for (const auto &child : children)
+                    {
+                        worker_context.progress->Record(child);
+                    }
+                    if (bypassed)
+                        worker_context.progress->Record(bypassed);
+                }
+                {
+                    std::lock_guard<std::mutex> lock(shards[worker].mutex);
+                    for (auto &child : children)
+                    {
+                        if (child->cost + child->h < incumbent_cost)
+                        {
+                            shards[worker].open.push(child);
+                            pending++;
+                        }
+                    }
+                }
+                current = bypassed;
+                from_open = false;
+            }
+            pending--;
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (int worker = 0; worker < threads; ++worker)
+    {
+        workers.emplace_back(work, worker);
+    }
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+
+    // Every node left is a candidate, so the best of them bounds the optimum
+    lower_bound = incumbent ? incumbent_cost.load() : INT_MAX;
+    for (auto &shard : shards)
+    {
+        if (!shard.open.empty())
+            lower_bound = std::min(lower_bound, shard.open.top()->cost + shard.open.top()->h);
+    }
+    if (lower_bound == INT_MAX)
+        lower_bound = root->cost + root->h;
+
+    if (aborted)
+        return nullptr;
+    return incumbent;
+}
+
+std::vector<PathPtr> Cbs::ReplanMembers(SearchContext &context, const CbsNode &node, const std::vector<PathPtr> &solution, const std::vector<int> &members, const Constraint &constraint, int max_steps, int &lower_bound, bool &out_of_steps) const
+{
+    // The new constraint binds its own agent; a positive one also keeps every other agent off its cell
+    auto added = [&](int member)
+    {
+        if (member == constraint.id)
+            return std::vector<Constraint>{constraint};
+        if (constraint.type == 6)
+            return ImpliedConstraints(constraint, member);
+        return std::vector<Constraint>{};
+    };
+    auto changes = [&](int member)
+    {
+        return constraint.type == 6 ? member != constraint.id && Displaced(*solution[member], constraint) : member == constraint.id;
+    };
+
+    std::vector<PathPtr> new_paths;
+    if (members.size() == 1)
+    {
+        int agent = members[0];
+        auto agent_constraints = node.Constraints(agent);
+        auto extra = added(agent);
+        agent_constraints.insert(agent_constraints.end(), extra.begin(), extra.end());
+        std::optional<CostPath> new_path;
+        if (constraint.type == 5)
+        {
+            // Among shortest paths, one with the fewest conflicts waits outside the corridor, not inside it
+            int path_bound;
+            new_path = ReplanAgentFocal(context, agent, solution, agent_constraints, path_bound, 1.0);
+        }
+        else
+            new_path = ReplanAgent(agent, context.sources[agent], context.goal_sequences[agent], agent_constraints);
+        if (new_path.has_value())
+            new_paths.push_back(std::make_shared<const CostPath>(std::move(new_path.value())));
+    }
+    else
+    {
+        // A meta-agent replans all of its members together; the constrained ones start from scratch
+        std::vector<std::vector<Constraint>> member_constraints;
+        std::vector<PathPtr> initial;
+        for (int member : members)
+        {
+            member_constraints.push_back(node.Constraints(member));
+            auto extra = added(member);
+            member_constraints.back().insert(member_constraints.back().end(), extra.begin(), extra.end());
+            initial.push_back(changes(member) ? nullptr : solution[member]);
+        }
+        auto group_paths = SolveGroup(context, members, member_constraints, initial, max_steps, lower_bound, &out_of_steps);
+        if (group_paths)
+            new_paths = std::move(group_paths.value());
+    }
+
+    // The low level cannot move an agent at t = 0, so a positive constraint may be unattainable
+    if (constraint.type == 6)
+    {
+        for (int k = 0; k < new_paths.size(); ++k)
+        {
+            if (members[k] != constraint.id && Displaced(*new_paths[k], constraint))
+                return {};
+        }
+    }
+    return new_paths;
+}
+
+std::shared_ptr<CbsNode> Cbs::Branch(SearchContext &context, const CbsNodePtr &current, const std::vector<PathPtr> &solution, const Constraint &constraint, std::pair<int, int> split, int max_steps) const
+{
+    const int num_agents = context.sources.size();
+
+    // Only the constrained (meta-)agent can change, or under a positive constraint
+    // the agents it displaces; every other path is shared with the parent
+    std::vector<std::vector<int>> groups;
+    if (constraint.type == 6)
+    {
+        std::vector<int> own = current->Members(constraint.id);
+        for (int other = 0; other < num_agents; ++other)
+        {
+            if (std::find(own.begin(), own.end(), other) != own.end() || !Displaced(*solution[other], constraint))
+                continue;
+            auto members = current->Members(other);
+            if (std::none_of(groups.begin(), groups.end(), [&](const std::vector<int> &group)
+                             { return group == members; }))
+                groups.push_back(members);
+        }
+    }
+    else
+        groups.push_back(current->Members(constraint.id));
+
+    std::vector<int> members;
+    std::vector<PathPtr> new_paths;
+    // Cost the groups add, counting a group whose search ran out of steps at its lower bound
+    int added_cost = 0;
+    bool deferred = false;
+    for (const auto &group : groups)
+    {
+        int group_cost = 0;
+        for (int member : group)
+        {
+            group_cost += static_cast<int>(solution[member]->size());
+        }
+        int lower_bound = 0;
+        bool out_of_steps = false;
+        auto group_paths = ReplanMembers(context, *current, solution, group, constraint, max_steps, lower_bound, out_of_steps);
+        if (group_paths.empty())
+        {
+            // Only a proof that the group has no solution drops the child
+            if (!out_of_steps)
+                return nullptr;
+            deferred = true;
+            added_cost += lower_bound - group_cost;
+            continue;
+        }
+        members.insert(members.end(), group.begin(), group.end());
+        new_paths.insert(new_paths.end(), group_paths.begin(), group_paths.end());
+        for (const auto &path : group_paths)
+        {
+            added_cost += static_cast<int>(path->size());
+        }
+        added_cost -= group_cost;
+    }
+
+    auto child = context.NewNode();
+    child->parent = current;
+    child->constraint = constraint;
+    child->groups = current->groups;
+    child->split = split;
+    child->depth = current->depth + 1;
+    child->fingerprint = current->fingerprint + ConstraintFingerprint(constraint);
+    child->conflicts = current->conflicts;
+    child->cost = current->cost;
+
+    // Deferred: the child stays open on its parent's paths, ranked by the bound
+    // the search reached, and is built again with twice the steps when expanded
+    if (deferred)
+    {
+        child->deferred_steps = max_steps > INT_MAX / 2 ? INT_MAX : 2 * max_steps;
+        child->h = std::max(current->h, added_cost);
+        return child;
+    }
+
+    auto child_solution = solution;
+    for (int k = 0; k < members.size(); ++k)
+    {
+        child->paths.emplace_back(members[k], new_paths[k]);
+        child->cost += static_cast<int>(new_paths[k]->size()) - static_cast<int>(solution[members[k]]->size());
+        child_solution[members[k]] = new_paths[k];
+    }
+    for (int member : members)
+    {
+        UpdateConflicts(child->conflicts, child_solution, member);
+    }
+    return child;
+}
+
+std::vector<CbsNodePtr> Cbs::Expand(SearchContext &context, const CbsNodePtr &current, CbsHeuristic search_heuristic, CbsNodePtr &bypassed) const
+{
+    const int num_agents = context.sources.size();
+
+    // A deferred child is built again in its place, with the larger budget
+    if (current->deferred_steps > 0)
+    {
+        const auto &parent = current->parent;
+        auto child = Branch(context, parent, parent->Solution(num_agents), *current->constraint, current->split, current->deferred_steps);
+        if (!child)
+            return {};
+        if (!child->deferred_steps)
+            child->h = ComputeHeuristic(context, *child, child->Solution(num_agents), search_heuristic);
+        return {child};
+    }
+
+    auto solution = current->Solution(num_agents);
+
+    ConflictCardinality cardinality;
+    int conflict_index = ChooseConflict(context, *current, solution, cardinality);
+    const Conflict &conflict = current->conflicts[conflict_index];
+
+    // MA-CBS: a pair that keeps conflicting on this branch is planned jointly from here on.
+    // A meta-agent search out of budget proves nothing, so the conflict is split as usual instead.
+    if (context.merge_threshold > 0 && BranchConflicts(*current, conflict.agent_1, conflict.agent_2) >= context.merge_threshold)
+    {
+        auto merged = Merge(context, current, solution, conflict, search_heuristic);
+        if (merged)
+            return {merged};
+    }
+
+    // Rectangle and corridor conflicts split once on barrier or range constraints
+    std::vector<Constraint> new_constraints = SymmetryConstraints(*current, solution, conflict, cardinality);
+    if (new_constraints.empty())
+        new_constraints = disjoint_splitting ? DisjointConstraints(conflict) : GenerateConstraints(conflict);
+
+    std::vector<CbsNodePtr> children;
+    for (const auto &constraint : new_constraints)
+    {
+        auto child = Branch(context, current, solution, constraint, {conflict.agent_1, conflict.agent_2}, meta_agent_search_steps);
+        if (!child)
+            continue;
+
+        // Bypass: an equal-cost path with fewer conflicts is as good as the parent's, without the split
+        if (bypass && cardinality != CARDINAL && !child->deferred_steps && child->cost == current->cost &&
+            child->conflicts.size() < current->conflicts.size())
+        {
+            child->constraint.reset();
+            child->split = {-1, -1};
+            child->depth = current->depth;
+            child->fingerprint = current->fingerprint;
+            bypassed = child;
+            return {};
+        }
+        if (!child->deferred_steps)
+        {
+            auto child_solution = solution;
+            for (const auto &[agent, path] : child->paths)
+            {
+                child_solution[agent] = path;
+            }
+            child->h = ComputeHeuristic(context, *child, child_solution, search_heuristic);
+        }
+        children.push_back(child);
+    }
+
+    return children;
+}
+
+CbsNodePtr Cbs::FocalSearch(SearchContext &context, const CbsNodePtr &root, bool pruning, int max_steps, int &lower_bound) const
+{
+    std::unordered_set<uint64_t> closed;
+    const int num_agents = context.sources.size();
+
+    // EECBS: average cost increase and conflict-count error of the best child, learned per expansion
+    double cost_error = 0.0;
+    double distance_error = 0.0;
+    int samples = 0;
+    auto estimate = [&](const CbsNode &node)
+    {
+        if (samples == 0)
+            return static_cast<double>(node.cost);
+        // A child may come out cheaper than its parent, but the cost still to come is never negative
+        double per_conflict_cost = std::max(0.0, cost_error / samples);
+        double per_conflict_distance = std::min(distance_error / samples, 0.9);
+        return node.cost + node.conflicts.size() / (1.0 - per_conflict_distance) * per_conflict_cost;
+    };
+
+    // Generated nodes are indexed in order. OPEN orders them by cost (ECBS) or by
+    // the estimate made when they were generated (EECBS), CLEANUP by lower bound,
+    // and FOCAL holds the OPEN nodes within w of the best, fewest conflicts first.
+    struct Entry
+    {
+        CbsNodePtr node;
+        double key;
+    };
+    std::vector<Entry> entries;
+    std::set<std::pair<double, int>> open;
+    std::set<std::pair<int, int>> cleanup;
+    std::set<std::tuple<int, double, int>> focal;
+    double focal_threshold = -1.0;
+    auto focal_key = [&](int index)
+    {
+        return std::make_tuple(static_cast<int>(entries[index].node->conflicts.size()), entries[index].key, index);
+    };
+    auto push = [&](const CbsNodePtr &node)
+    {
+        int index = entries.size();
+        entries.push_back({node, explicit_estimation ? estimate(*node) : static_cast<double>(node->cost)});
+        open.insert({entries[index].key, index});
+        cleanup.insert({node->lower_bound, index});
+        if (entries[index].key <= focal_threshold)
+            focal.insert(focal_key(index));
+    };
+    auto pop = [&](int index)
+    {
+        open.erase({entries[index].key, index});
+        cleanup.erase({entries[index].node->lower_bound, index});
+        focal.erase(focal_key(index));
+        return std::move(entries[index].node);
+    };
+    // Move FOCAL's threshold to w times the best of CLEANUP (ECBS) or OPEN (EECBS),
+    // admitting or dropping only the OPEN nodes between the old and new thresholds
+    auto update_focal = [&]()
+    {
+        double threshold = suboptimality * (explicit_estimation ? open.begin()->first : cleanup.begin()->first);
+        if (threshold > focal_threshold)
+        {
+            for (auto it = open.upper_bound({focal_threshold, INT_MAX}); it != open.end() && it->first <= threshold; ++it)
+                focal.insert(focal_key(it->second));
+        }
+        else
+        {
+            for (auto it = open.upper_bound({threshold, INT_MAX}); it != open.end() && it->first <= focal_threshold; ++it)
+                focal.erase(focal_key(it->second));
+        }
+        focal_threshold = threshold;
+    };
+
+    push(root);
+    int step = 0;
+    while (!open.empty())
+    {
+        step++;
+        if (step > max_steps || context.Expired())
+            return nullptr;
+
+        // The cheapest lower bound in open bounds the optimal cost from below
+        update_focal();
+        auto [cleanup_bound, cleanup_index] = *cleanup.begin();
+        lower_bound = std::max(lower_bound, cleanup_bound);
+        double bound = suboptimality * cleanup_bound;
+
+        int selected = cleanup_index;
+        if (!explicit_estimation)
+        {
+            // ECBS: the node with the fewest conflicts among those within the bound
+            if (!focal.empty())
+                selected = std::get<2>(*focal.begin());
+        }
+        else
+        {
+            // EECBS: the fewest conflicts among nodes near the best estimate, else the best estimate, else cleanup
+            int focal_index = std::get<2>(*focal.begin());
+            int best_estimate = open.begin()->second;
+            if (entries[focal_index].node->cost <= bound)
+                selected = focal_index;
+            else if (entries[best_estimate].node->cost <= bound)
+                selected = best_estimate;
+        }
+
+        CbsNodePtr current = pop(selected);
+
+        if (pruning && !closed.insert(current->fingerprint).second)
+            continue;
+
+        // Every path is within w of its own bound, so any conflict-free node is within w of optimal
+        if (current->conflicts.empty())
+            return current;
+
+        auto solution = current->Solution(num_agents);
+
+        ConflictCardinality cardinality;
+        int conflict_index = ChooseConflict(context, *current, solution, cardinality);
+        std::vector<Constraint> new_constraints = SymmetryConstraints(*current, solution, current->conflicts[conflict_index], cardinality);
+        if (new_constraints.empty())
+            new_constraints = GenerateConstraints(current->conflicts[conflict_index]);
+
+        CbsNodePtr best_child = nullptr;
+        for (const auto &constraint : new_constraints)
+        {
+            int agent = constraint.id;
+            auto agent_constraints = current->Constraints(agent);
+            agent_constraints.push_back(constraint);
+            int path_bound;
+            auto new_path = ReplanAgentFocal(context, agent, solution, agent_constraints, path_bound, suboptimality);
+
+            if (!new_path.has_value())
+                continue;
+
+            auto child = context.NewNode();
+            child->parent = current;
+            child->constraint = constraint;
+            child->depth = current->depth + 1;
+            child->fingerprint = current->fingerprint + ConstraintFingerprint(constraint);
+            child->paths.emplace_back(agent, std::make_shared<const CostPath>(std::move(new_path.value())));
+            child->path_bounds.emplace_back(agent, path_bound);
+
+            auto child_solution = solution;
+            child_solution[agent] = child->paths.back().second;
+            child->conflicts = current->conflicts;
+            UpdateConflicts(child->conflicts, child_solution, agent);
+            child->cost = current->cost - static_cast<int>(solution[agent]->size()) + static_cast<int>(child_solution[agent]->size());
+            // A child's solutions are a subset of its parent's, so its bound never drops
+            child->lower_bound = std::max(current->lower_bound, current->lower_bound - current->PathBound(agent) + path_bound);
+
+            if (!best_child || child->cost < best_child->cost)
+                best_child = child;
+            if (context.progress)
+                context.progress->Record(child);
+            push(child);
+        }
+
+        if (explicit_estimation && best_child)
+        {
+            cost_error += best_child->cost - current->cost;
+            distance_error += static_cast<double>(best_child->conflicts.size()) - (static_cast<double>(current->conflicts.size()) - 1.0);
+            samples++;
+        }
+    }
+    return nullptr;
+}
+
+uint64_t ConstraintFingerprint(const Constraint &constraint)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (int field : {constraint.type, constraint.id, constraint.x, constraint.y, constraint.time, constraint.x2, constraint.y2, constraint.time_end})
+    {
+        hash ^= static_cast<uint32_t>(field);
+        hash *= 0x100000001b3ULL;
+        hash ^= hash >> 29;
+    }
+    return hash;
+}
+
+PathPtr CbsNode::Path(int agent) const
+{
+    for (const CbsNode *node = this; node; node = node->parent.get())
+    {
+        for (const auto &[id, path] : node->paths)
+        {
+            if (id == agent)
+                return path;
+        }
+    }
+    return nullptr;
+}
+
+std::vector<PathPtr> CbsNode::Solution(int num_agents) const
+{
+    std::vector<PathPtr> solution(num_agents);
+    int missing = num_agents;
+    for (const CbsNode *node = this; node && missing > 0; node = node->parent.get())
+    {
+        for (const auto &[id, path] : node->paths)
+        {
+            if (!solution[id])
+            {
+                solution[id] = path;
+                --missing;
+            }
+        }
+    }
+    return solution;
+}
+
+std::vector<int> CbsNode::Members(int agent) const
+{
+    if (!groups)
+        return {agent};
+
+    std::vector<int> members;
+    for (int other = 0; other < groups->size(); ++other)
+    {
+        if ((*groups)[other] == (*groups)[agent])
+            members.push_back(other);
+    }
+    return members;
+}
+
+int CbsNode::PathBound(int agent) const
+{
+    for (const CbsNode *node = this; node; node = node->parent.get())
+    {
+        for (const auto &[id, bound] : node->path_bounds)
+        {
+            if (id == agent)
+                return bound;
+        }
+    }
+    return 0;
+}
+
+std::vector<Constraint> CbsNode::Constraints(int agent) const
+{
+    std::vector<Constraint> constraints;
+    for (const CbsNode *node = this; node; node = node->parent.get())
+    {
+        if (!node->constraint)
+            continue;
+        if (node->constraint->id == agent)
+            constraints.push_back(*node->constraint);
+        else if (node->constraint->type == 6)
+        {
+            // Another agent's positive constraint keeps this one off its cell; reversed below with the rest
+            auto implied = ImpliedConstraints(*node->constraint, agent);
+            constraints.insert(constraints.end(), implied.rbegin(), implied.rend());
+        }
+    }
+    // Root-to-leaf order, as the constraints were added
+    std::reverse(constraints.begin(), constraints.end());
+    return constraints;
+}
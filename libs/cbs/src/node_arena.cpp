@@ -0,0 +1,37 @@
+#include "node_arena.h"
+
+NodeArena::NodeArena(std::size_t limit) : limit(limit), buffer(&upstream) {}
+
+void *NodeArena::CountingResource::do_allocate(std::size_t bytes, std::size_t alignment)
+{
+    void *p = std::pmr::new_delete_resource()->allocate(bytes, alignment);
+    footprint += bytes;
+    return p;
+}
+
+// Blocks go back only when the buffer is destroyed; the footprint keeps the peak
+void NodeArena::CountingResource::do_deallocate(void *p, std::size_t bytes, std::size_t alignment)
+{
+    std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+}
+
+bool NodeArena::CountingResource::do_is_equal(const std::pmr::memory_resource &other) const noexcept
+{
+    return this == &other;
+}
+
+void *NodeArena::do_allocate(std::size_t bytes, std::size_t alignment)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return buffer.allocate(bytes, alignment);
+}
+
+// Monotonic: memory is reclaimed in bulk with the arena
+void NodeArena::do_deallocate(void *, std::size_t, std::size_t)
+{
+}
+
+bool NodeArena::do_is_equal(const std::pmr::memory_resource &other) const noexcept
+{
+    return this == &other;
+}
@@ -0,0 +1,155 @@
+#include "path_cache.h"
+#include "cbs_alg.h"
+#include <algorithm>
+#include <tuple>
+
+PathCache::PathCache(size_t capacity) : capacity(capacity) {}
+
+static uint64_t Mix(uint64_t hash, int64_t value)
+{
+    hash ^= static_cast<uint64_t>(value) + 0x9E3779B97F4A7C15ULL + (hash << 6) + (hash >> 2);
+    return hash;
+}
+
+uint64_t PathCache::Hash(int agent, const Pair &start, const std::vector<Pair> &goals, int dwell,
+                         const std::vector<Constraint> &constraints)
+{
+    uint64_t hash = Mix(0, agent);
+    hash = Mix(hash, start.first);
+    hash = Mix(hash, start.second);
+    for (const auto &goal : goals)
+    {
+        hash = Mix(hash, goal.first);
+        hash = Mix(hash, goal.second);
+    }
+    hash = Mix(hash, dwell);
+
+    // Summed fingerprints do not depend on the order of the constraints
+    uint64_t fingerprint = 0;
+    for (const auto &constraint : constraints)
+    {
+        fingerprint += ConstraintFingerprint(constraint);
+    }
+    return Mix(hash, static_cast<int64_t>(fingerprint));
+}
+
+std::vector<Constraint> PathCache::Sorted(const std::vector<Constraint> &constraints)
+{
+    std::vector<Constraint> sorted = constraints;
+    std::sort(sorted.begin(), sorted.end(), [](const Constraint &a, const Constraint &b)
+              { return std::tie(a.id, a.type, a.x, a.y, a.time, a.x2, a.y2, a.time_end) <
+                       std::tie(b.id, b.type, b.x, b.y, b.time, b.x2, b.y2, b.time_end); });
+    return sorted;
+}
+
+bool PathCache::Entry::Matches(int agent, const Pair &start, const std::vector<Pair> &goals, int dwell,
+                               const std::vector<Constraint> &sorted) const
+{
+    if (this->agent != agent || this->start != start || this->goals != goals || this->dwell != dwell ||
+        constraints.size() != sorted.size())
+        return false;
+
+    for (int i = 0; i < sorted.size(); ++i)
+    {
+        const Constraint &a = constraints[i];
+        const Constraint &b = sorted[i];
+        if (std::tie(a.id, a.type, a.x, a.y, a.time, a.x2, a.y2, a.time_end) !=
+            std::tie(b.id, b.type, b.x, b.y, b.time, b.x2, b.y2, b.time_end))
+            return false;
+    }
+    return true;
+}
+
+bool PathCache::Find(int agent, const Pair &start, const std::vector<Pair> &goals, int dwell,
+                     const std::vector<Constraint> &constraints, std::optional<Path> &result)
+{
+    if (capacity == 0)
+        return false;
+
+    uint64_t hash = Hash(agent, start, goals, dwell, constraints);
+    auto sorted = Sorted(constraints);
+    Shard &shard = shards[hash % SHARDS];
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto [first, last] = shard.index.equal_range(hash);
+        for (auto it = first; it != last; ++it)
+        {
+            if (it->second->Matches(agent, start, goals, dwell, sorted))
+            {
+                shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+                result = it->second->result;
+                ++hits;
+                return true;
+            }
+        }
+    }
+    ++misses;
+    return false;
+}
+
+void PathCache::Insert(int agent, const Pair &start, const std::vector<Pair> &goals, int dwell,
+                       const std::vector<Constraint> &constraints, const std::optional<Path> &result)
+{
+    size_t shard_capacity = (capacity + SHARDS - 1) / SHARDS;
+    if (shard_capacity == 0)
+        return;
+
+    uint64_t hash = Hash(agent, start, goals, dwell, constraints);
+    auto sorted = Sorted(constraints);
+    Shard &shard = shards[hash % SHARDS];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    // Another thread may have planned the same search meanwhile
+    auto [first, last] = shard.index.equal_range(hash);
+    for (auto it = first; it != last; ++it)
+    {
+        if (it->second->Matches(agent, start, goals, dwell, sorted))
+            return;
+    }
+
+    shard.entries.push_front({hash, agent, start, goals, dwell, std::move(sorted), result});
+    shard.index.emplace(hash, shard.entries.begin());
+
+    while (shard.entries.size() > shard_capacity)
+    {
+        auto oldest = std::prev(shard.entries.end());
+        auto [from, to] = shard.index.equal_range(oldest->hash);
+        for (auto it = from; it != to; ++it)
+        {
+            if (it->second == oldest)
+            {
+                shard.index.erase(it);
+                break;
+            }
+        }
+        shard.entries.pop_back();
+    }
+}
+
+void PathCache::SetCapacity(size_t new_capacity)
+{
+    capacity = new_capacity;
+    if (new_capacity == 0)
+        Clear();
+}
+
+void PathCache::Clear()
+{
+    for (auto &shard : shards)
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.entries.clear();
+        shard.index.clear();
+    }
+}
+
+size_t PathCache::Size() const
+{
+    size_t size = 0;
+    for (const auto &shard : shards)
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        size += shard.entries.size();
+    }
+    return size;
+}
@@ -0,0 +1,323 @@
+#include "reservation_table.h"
+#include <algorithm>
+#include <tuple>
+
+ReservationTable::ReservationTable(const std::vector<CostPath> &solution, int robustness) : solution(solution), robustness(robustness)
+{
+    int entries = 0;
+    offset.reserve(solution.size());
+    for (const auto &path : solution)
+    {
+        offset.push_back(entries);
+        entries += path.size();
+    }
+
+    entry_agent.resize(entries);
+    cell_time_next.assign(entries, -1);
+    cell_next.assign(entries, -1);
+    cell_time_head.Init(entries);
+    cell_head.Init(entries);
+
+    for (int i = 0; i < solution.size(); ++i)
+    {
+        const auto &path = solution[i];
+        for (int t = 0; t < path.size(); ++t)
+        {
+            int entry = offset[i] + t;
+            entry_agent[entry] = i;
+
+            bool inserted;
+            int &head = cell_time_head.Insert(CellTimeKey(path[t][0], path[t][1], t), entry, inserted);
+            if (!inserted)
+            {
+                cell_time_next[entry] = head;
+                head = entry;
+            }
+
+            int &cell = cell_head.Insert(CellKey(path[t][0], path[t][1]), entry, inserted);
+            if (!inserted)
+            {
+                cell_next[entry] = cell;
+                cell = entry;
+            }
+        }
+    }
+}
+
+uint64_t ReservationTable::CellKey(int x, int y)
+{
+    return (static_cast<uint64_t>(static_cast<uint32_t>(x)) << 32) | static_cast<uint32_t>(y);
+}
+
+uint64_t ReservationTable::CellTimeKey(int x, int y, int t)
+{
+    // 20 bits per coordinate and 24 bits of time are plenty for grid maps
+    return (static_cast<uint64_t>(t) << 40) |
+           (static_cast<uint64_t>(x & 0xFFFFF) << 20) |
+           static_cast<uint64_t>(y & 0xFFFFF);
+}
+
+void ReservationTable::HeadMap::Init(int entries)
+{
+    uint64_t capacity = 16;
+    while (capacity < 2 * static_cast<uint64_t>(entries))
+        capacity <<= 1;
+    keys.assign(capacity, 0);
+    heads.assign(capacity, -1);
+    mask = capacity - 1;
+}
+
+// Slots hold key + 1 so that zero marks an empty slot
+static uint64_t Slot(uint64_t key, uint64_t mask)
+{
+    return ((key + 1) * 0x9E3779B97F4A7C15ULL >> 20) & mask;
+}
+
+int &ReservationTable::HeadMap::Insert(uint64_t key, int entry, bool &inserted)
+{
+    uint64_t slot = Slot(key, mask);
+    while (keys[slot] != 0 && keys[slot] != key + 1)
+        slot = (slot + 1) & mask;
+
+    inserted = keys[slot] == 0;
+    if (inserted)
+    {
+        keys[slot] = key + 1;
+        heads[slot] = entry;
+    }
+    return heads[slot];
+}
+
+int ReservationTable::HeadMap::Find(uint64_t key) const
+{
+    for (uint64_t slot = Slot(key, mask); keys[slot] != 0; slot = (slot + 1) & mask)
+    {
+        if (keys[slot] == key + 1)
+            return heads[slot];
+    }
+    return -1;
+}
+
+template <typename Visitor>
+void ReservationTable::VisitConflicts(int i, Visitor &&visit) const
+{
+    const auto &path_1 = solution[i];
+    if (path_1.empty())
+        return;
+
+    for (int t = 0; t < path_1.size(); ++t)
+    {
+        int x = path_1[t][0];
+        int y = path_1[t][1];
+
+        // Vertex conflicts: another agent in the same cell at the same time
+        for (int e = cell_time_head.Find(CellTimeKey(x, y, t)); e != -1; e = cell_time_next[e])
+        {
+            int j = entry_agent[e];
+            if (j > i)
+                visit(Conflict{VERTEX_CONFLICT, i, j, x, y, x, y, t, t});
+        }
+
+        // Edge conflicts: an agent standing on our next cell moves onto our current one
+        if (t + 1 < path_1.size())
+        {
+            int next_x = path_1[t + 1][0];
+            int next_y = path_1[t + 1][1];
+            for (int e = cell_time_head.Find(CellTimeKey(next_x, next_y, t)); e != -1; e = cell_time_next[e])
+            {
+                int j = entry_agent[e];
+                if (j <= i || t + 1 >= solution[j].size())
+                    continue;
+                const auto &step_2 = solution[j][t + 1];
+                if (step_2[0] == x && step_2[1] == y)
+                    visit(Conflict{EDGE_CONFLICT, i, j, x, y, next_x, next_y, t + 1, t + 1});
+            }
+        }
+
+        // Following conflicts: we enter a cell another agent held one step earlier
+        if (t > 0)
+        {
+            for (int e = cell_time_head.Find(CellTimeKey(x, y, t - 1)); e != -1; e = cell_time_next[e])
+            {
+                int j = entry_agent[e];
+                if (j > i && t < solution[j].size())
+                    visit(Conflict{FOLLOWING_CONFLICT, i, j, x, y, x, y, t, t - 1});
+            }
+        }
+
+        // ... or another agent enters our cell one step later
+        for (int e = cell_time_head.Find(CellTimeKey(x, y, t + 1)); e != -1; e = cell_time_next[e])
+        {
+            int j = entry_agent[e];
+            if (j > i)
+                visit(Conflict{FOLLOWING_CONFLICT, i, j, x, y, x, y, t, t + 1});
+        }
+
+        // k-robust plans: the same, up to k steps apart. An agent parked on
+        // the cell before we arrive is a stopping conflict instead.
+        for (int d = 2; d <= robustness; ++d)
+        {
+            for (int e = t >= d ? cell_time_head.Find(CellTimeKey(x, y, t - d)) : -1; e != -1; e = cell_time_next[e])
+            {
+                int j = entry_agent[e];
+                if (j > i && (t < solution[j].size() || solution[j].back()[0] != x || solution[j].back()[1] != y))
+                    visit(Conflict{FOLLOWING_CONFLICT, i, j, x, y, x, y, t, t - d});
+            }
+            for (int e = cell_time_head.Find(CellTimeKey(x, y, t + d)); e != -1; e = cell_time_next[e])
+            {
+                int j = entry_agent[e];
+                if (j > i)
+                    visit(Conflict{FOLLOWING_CONFLICT, i, j, x, y, x, y, t, t + d});
+            }
+        }
+    }
+
+    // Stopping conflicts: another agent crosses our goal after we have parked on it
+    int goal_x = path_1.back()[0];
+    int goal_y = path_1.back()[1];
+    int goal_time = path_1.size();
+    for (int e = cell_head.Find(CellKey(goal_x, goal_y)); e != -1; e = cell_next[e])
+    {
+        int j = entry_agent[e];
+        int t = e - offset[j];
+        if (j != i && t >= goal_time)
+            visit(Conflict{STOPPING_CONFLICT, i, j, goal_x, goal_y, goal_x, goal_y, goal_time - 1, t});
+    }
+}
+
+// Order of the pairwise scans within one conflict type
+static bool ScanOrder(const Conflict &a, const Conflict &b)
+{
+    return std::tie(a.agent_1, a.agent_2, a.time_2, a.time_1) < std::tie(b.agent_1, b.agent_2, b.time_2, b.time_1);
+}
+
+static bool FollowScanOrder(const Conflict &a, const Conflict &b)
+{
+    return std::tie(a.agent_1, a.agent_2, a.time_1, a.time_2) < std::tie(b.agent_1, b.agent_2, b.time_1, b.time_2);
+}
+
+bool ReservationTable::Precedes(const Conflict &a, const Conflict &b)
+{
+    if (a.type != b.type)
+        return a.type < b.type;
+    return a.type == FOLLOWING_CONFLICT ? FollowScanOrder(a, b) : ScanOrder(a, b);
+}
+
+std::vector<Conflict> ReservationTable::FindConflicts() const
+{
+    std::vector<Conflict> by_type[4];
+
+    for (int i = 0; i < solution.size(); ++i)
+    {
+        VisitConflicts(i, [&](const Conflict &conflict)
+                       { by_type[conflict.type].push_back(conflict); });
+    }
+
+    // Buckets are chained in insertion order, so restore the pairwise scan order
+    std::vector<Conflict> conflicts;
+    conflicts.reserve(by_type[0].size() + by_type[1].size() + by_type[2].size() + by_type[3].size());
+    for (auto &typed : by_type)
+    {
+        std::sort(typed.begin(), typed.end(), Precedes);
+        conflicts.insert(conflicts.end(), typed.begin(), typed.end());
+    }
+
+    return conflicts;
+}
+
+std::optional<Conflict> ReservationTable::FindFirstConflict() const
+{
+    // The best conflict of each type; types rank before agents, so only a
+    // vertex conflict lets the sweep stop early
+    std::optional<Conflict> best[4];
+
+    for (int i = 0; i < solution.size(); ++i)
+    {
+        VisitConflicts(i, [&](const Conflict &conflict)
+                       {
+                           auto &current = best[conflict.type];
+                           if (!current || Precedes(conflict, *current))
+                               current = conflict; });
+
+        if (best[VERTEX_CONFLICT])
+            break;
+    }
+
+    for (const auto &conflict : best)
+    {
+        if (conflict)
+            return conflict;
+    }
+    return std::nullopt;
+}
+
+int ReservationTable::CountConflicts() const
+{
+    int count = 0;
+    for (int i = 0; i < solution.size(); ++i)
+    {
+        VisitConflicts(i, [&](const Conflict &)
+                       { ++count; });
+    }
+    return count;
+}
+
+void ReservationTable::FindPairConflicts(const CostPath &path_1, int i, const CostPath &path_2, int j, std::vector<Conflict> &conflicts, int robustness)
+{
+    if (path_1.empty() || path_2.empty())
+        return;
+
+    int min_size = std::min(path_1.size(), path_2.size());
+    auto same_cell = [](const std::vector<int> &a, const std::vector<int> &b)
+    {
+        return a[0] == b[0] && a[1] == b[1];
+    };
+
+    for (int t = 0; t < min_size; ++t)
+    {
+        int x = path_1[t][0];
+        int y = path_1[t][1];
+
+        if (same_cell(path_1[t], path_2[t]))
+            conflicts.push_back({VERTEX_CONFLICT, i, j, x, y, x, y, t, t});
+
+        if (t + 1 < min_size && same_cell(path_1[t], path_2[t + 1]) && same_cell(path_2[t], path_1[t + 1]))
+            conflicts.push_back({EDGE_CONFLICT, i, j, x, y, path_2[t][0], path_2[t][1], t + 1, t + 1});
+
+        if (t > 0 && same_cell(path_1[t], path_2[t - 1]))
+            conflicts.push_back({FOLLOWING_CONFLICT, i, j, x, y, x, y, t, t - 1});
+
+        if (t + 1 < path_2.size() && same_cell(path_1[t], path_2[t + 1]))
+            conflicts.push_back({FOLLOWING_CONFLICT, i, j, x, y, x, y, t, t + 1});
+    }
+
+    // k-robust following conflicts, scanned over all of path_1 as in VisitConflicts
+    for (int t = 0; robustness > 1 && t < path_1.size(); ++t)
+    {
+        int x = path_1[t][0];
+        int y = path_1[t][1];
+        for (int d = 2; d <= robustness; ++d)
+        {
+            if (t >= d && t - d < path_2.size() && same_cell(path_1[t], path_2[t - d]) &&
+                (t < path_2.size() || !same_cell(path_1[t], path_2.back())))
+                conflicts.push_back({FOLLOWING_CONFLICT, i, j, x, y, x, y, t, t - d});
+
+            if (t + d < path_2.size() && same_cell(path_1[t], path_2[t + d]))
+                conflicts.push_back({FOLLOWING_CONFLICT, i, j, x, y, x, y, t, t + d});
+        }
+    }
+
+    // Either agent may be parked on its goal while the other passes over it
+    auto stopping = [&](const CostPath &parked_path, int parked, const CostPath &path, int passing)
+    {
+        const auto &goal = parked_path.back();
+        int goal_time = parked_path.size();
+        for (int t = goal_time; t < path.size(); ++t)
+        {
+            if (same_cell(path[t], goal))
+                conflicts.push_back({STOPPING_CONFLICT, parked, passing, goal[0], goal[1], goal[0], goal[1], goal_time - 1, t});
+        }
+    };
+    stopping(path_1, i, path_2, j);
+    stopping(path_2, j, path_1, i);
+}
@@ -1,6 +1,5 @@
 #pragma once
 #include <vector>
-#include <unordered_set>
 
 enum Direction
 {
@@ -13,20 +12,25 @@ enum Direction
 
 struct Vertex
 {
+    int id; // index into Graph::locations
     int x, y;
     Direction direction;
     Vertex() = default;
-    Vertex(int a, int b, Direction dir) : x(a), y(b), direction(dir) {}
+    Vertex(int i, int a, int b, Direction dir) : id(i), x(a), y(b), direction(dir) {}
 };
 
 class Graph
 {
 public:
     int width, height;
-    std::unordered_set<Vertex *> locations;
+    // Every cell, indexed by vertex id y * width + x
+    std::vector<Vertex *> locations;
 
     Graph() = default;
     Graph(int w, int h);
     ~Graph();
+    Vertex *GetVertex(int x, int y);
     std::vector<Vertex *> GetNeighbors(const Vertex *v);
+    // Allocation-free variant: writes up to four neighbours and returns how many
+    int GetNeighbors(const Vertex *v, Vertex *neighbors[4]);
 };
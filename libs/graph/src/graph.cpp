@@ -9,8 +9,8 @@ Graph::Graph(int w, int h)
     {
         for (int x = 0; x < width; ++x)
         {
-            Vertex *v = new Vertex(x, y, Direction::Up);
-            locations.insert(v);
+            Vertex *v = new Vertex(locations.size(), x, y, Direction::Up);
+            locations.push_back(v);
         }
     }
 }
@@ -24,38 +24,39 @@ Graph::~Graph()
     locations.clear();
 }
 
-std::vector<Vertex *> Graph::GetNeighbors(const Vertex *v)
+Vertex *Graph::GetVertex(int x, int y)
 {
-    std::vector<Vertex *> neighbors;
+    if (x < 0 || y < 0 || x >= width || y >= height)
+        return nullptr;
+    return locations[y * width + x];
+}
 
-    int dx[] = {0, 0, -1, 1};
-    int dy[] = {-1, 1, 0, 0};
+std::vector<Vertex *> Graph::GetNeighbors(const Vertex *v)
+{
+    Vertex *neighbors[4];
+    int count = GetNeighbors(v, neighbors);
+    return std::vector<Vertex *>(neighbors, neighbors + count);
+}
 
-    std::vector<Direction> direction_vector = {Direction::Up, Direction::Down, Direction::Left, Direction::Right};
+int Graph::GetNeighbors(const Vertex *v, Vertex *neighbors[4])
+{
+    static const int dx[] = {0, 0, -1, 1};
+    static const int dy[] = {-1, 1, 0, 0};
+    static const Direction direction_vector[] = {Direction::Up, Direction::Down, Direction::Left, Direction::Right};
 
+    int count = 0;
     for (int i = 0; i < 4; ++i)
     {
         int nx = v->x + dx[i];
         int ny = v->y + dy[i];
 
-        if (nx >= 0 && ny >= 0 && nx < width && ny < height)
+        Vertex *neighbor = GetVertex(nx, ny);
+        if (neighbor)
         {
-            Vertex *neighbor = nullptr;
-            for (Vertex *vert : locations)
-            {
-                if (vert->x == nx && vert->y == ny)
-                {
-                    neighbor = vert;
-                    neighbor->direction = direction_vector[i];
-                    break;
-                }
-            }
-            if (neighbor)
-            {
-                neighbors.push_back(neighbor);
-            }
+            neighbor->direction = direction_vector[i];
+            neighbors[count++] = neighbor;
         }
     }
 
-    return neighbors;
+    return count;
 }
@@ -0,0 +1,116 @@
+#pragma once
+
+#include "pibt_alg.h"
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <queue>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+// What anytime refinement minimizes
+enum LacamObjective
+{
+    // Steps each agent spends away from its goal or moving onto it, summed
+    LACAM_SUM_OF_COSTS,
+    // Steps until every agent is on its goal
+    LACAM_MAKESPAN
+};
+
+// A cheaper solution found by anytime search, and when
+struct LacamImprovement
+{
+    double seconds;
+    int cost;
+};
+
+// LaCAM: lazy depth-first search over configurations (every agent's vertex and
+// heading), with PIBT generating each successor. A configuration is revisited
+// under more and more constraints fixing single agents' next moves, so every
+// successor is eventually tried and the search is complete: it finds a solution
+// whenever one exists, and usually follows plain PIBT straight to the goal.
+// In anytime mode (LaCAM*) it keeps searching after the first solution,
+// rewiring the configurations it has seen towards cheaper parents, until the
+// time limit or until the search space is exhausted and the plan is optimal.
+class lacam
+{
+public:
+    int num_agents = 0;
+    bool failed = false;
+    // Search budget for run(); zero for none
+    std::chrono::milliseconds time_limit{30000};
+    // Keep improving the first solution until time_limit instead of returning it
+    bool anytime = false;
+    LacamObjective objective = LACAM_SUM_OF_COSTS;
+
+    // Cost of the returned solution under objective, whether anytime search
+    // proved it optimal, and every improvement on the way there
+    int cost = 0;
+    bool optimal = false;
+    std::vector<LacamImprovement> improvements;
+    // High-level nodes created and successors generated by the last run()
+    int nodes_created = 0;
+    int successors_generated = 0;
+
+    lacam(int w, int h,
+          const std::vector<std::vector<int>> &starts,
+          const std::vector<std::vector<int>> &goals);
+
+    void run();
+
+    // Configurations in the solution, and one agent's trajectory as (x, y, direction) steps
+    int PathLength() const;
+    std::vector<std::vector<int>> Path(int agent) const;
+
+private:
+    // Low-level search: a node fixes one agent's next vertex on top of its parent's constraints
+    struct LowLevelNode
+    {
+        const LowLevelNode *parent;
+        int depth;
+        int agent;
+        int vertex;
+    };
+
+    // High-level search: one configuration, packed as vertex * 5 + heading per agent
+    struct HighLevelNode
+    {
+        std::vector<int> state;
+        HighLevelNode *parent;
+        // Cost from the start along parent, and a lower bound on the cost to the goal
+        int g;
+        int h;
+        // Successors seen so far, for rewiring when a cheaper route here turns up
+        std::vector<HighLevelNode *> neighbors;
+        std::vector<float> priorities;
+        // Agents by descending priority, the order the low-level search fixes them in
+        std::vector<int> order;
+        // Constraint sets not yet tried from this configuration, breadth first
+        std::queue<const LowLevelNode *> search_tree;
+    };
+
+    struct StateHash
+    {
+        size_t operator()(const std::vector<int> &state) const;
+    };
+
+    pibt generator;
+    std::vector<int> start_state;
+    std::vector<float> start_priorities;
+    std::mt19937 rng;
+
+    // Storage for one run; deques keep node addresses stable
+    std::deque<HighLevelNode> nodes;
+    std::deque<LowLevelNode> low_level_nodes;
+    std::unordered_map<std::vector<int>, HighLevelNode *, StateHash> explored;
+    std::vector<std::vector<int>> solution;
+
+    HighLevelNode *CreateNode(const std::vector<int> &state, HighLevelNode *parent);
+    bool IsGoal(const std::vector<int> &state) const;
+    int TransitionCost(const std::vector<int> &from, const std::vector<int> &to) const;
+    int Heuristic(const std::vector<int> &state) const;
+    // Runs PIBT from node's configuration under the constraints; false if they collide
+    bool Successor(const HighLevelNode *node, const LowLevelNode *constraint, std::vector<int> &next);
+    void ExpandLowLevel(HighLevelNode *node, const LowLevelNode *constraint);
+};
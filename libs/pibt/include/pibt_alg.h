@@ -1,55 +1,117 @@
 #pragma once
 
 #include <graph.h>
+#include <random>
 #include <vector>
-#include <unordered_map>
 
-// PIBT agent
-struct Agent
+// One agent's state at one timestep of the packed trajectory buffer
+struct TrajectoryStep
 {
-    int id;
-    Vertex *v_now;
-    Vertex *v_next;
-    Vertex *start;
-    Vertex *goal;
-    float priority;
-    bool reached_goal;
-    Direction current_direction;
-    std::vector<std::vector<int>> Path;
-
-    Agent(int i, Vertex *vnow, Vertex *vnext, Vertex *s, Vertex *g, float p, bool reached_goal, Direction cd) : id(i), v_now(vnow), v_next(vnext), start(s), goal(g), priority(p), reached_goal(reached_goal), current_direction(cd)
-    {
-        Path = {{s->x, s->y, s->direction}, {s->x, s->y, s->direction}};
-    }
+    int vertex;
+    Direction direction;
 };
 
-// Alias for a collection of agents
-using Agents = std::vector<Agent *>;
-
-// PIBT class
+// PIBT class. Agents are stored as parallel arrays indexed by agent id, so the
+// per-step passes stream through memory instead of chasing per-agent objects.
 class pibt
 {
 public:
     Graph graph;
-    Agents agents;
+    int num_agents = 0;
     bool failed = false;
     int timesteps = 0;
+    // Whether run() and step() append to the trajectory buffer; lifelong
+    // callers that read Position() every tick can turn this off
+    bool record_trajectory = true;
+    // Order equally close candidate vertices at random instead of by direction,
+    // so PIBT run again and again from similar configurations does not keep
+    // repeating the same moves
+    bool random_tie_breaking = false;
+
+    // Per-agent state; vertices are graph vertex ids, v_next is -1 while undecided
+    std::vector<int> v_now;
+    std::vector<int> v_next;
+    std::vector<int> goal;
+    std::vector<float> priority;
+    std::vector<Direction> heading;
+    std::vector<char> reached_goal;
 
     pibt(int w, int h,
          const std::vector<std::vector<int>> &starts,
          const std::vector<std::vector<int>> &goals);
-    ~pibt();
 
+    // Plans until every agent has reached its goal
     void run();
 
-    bool PIBT(Agent *ai, Agent *aj = nullptr);
-    Agent *FindConflictingAgent(const Vertex *v, const Agent *agent);
+    // Lifelong use: advances every agent by one timestep. Goals can be changed
+    // and agents added or removed between steps; agent ids stay stable.
+    void step();
+    void setGoal(int agent, int x, int y);
+    // Returns the new agent's id, reusing the id of a removed agent if any
+    int addAgent(const std::vector<int> &start, const std::vector<int> &goal);
+    void removeAgent(int agent);
+
+    // Successor generator for LaCAM: puts the agents in the given configuration,
+    // fixes the next move of each constrained (agent, vertex) pair and plans the
+    // rest with PIBT. Returns false if the fixed moves collide; otherwise v_now
+    // and heading hold the successor configuration.
+    bool StepFrom(const std::vector<int> &vertices, const std::vector<Direction> &headings,
+                  const std::vector<std::pair<int, int>> &constraints);
+
+    // Decides ai's next vertex, pushing undecided agents out of the way by
+    // priority inheritance; aj is the agent ai inherited from, if any. Runs
+    // the inheritance chain on an explicit stack instead of recursing.
+    bool PIBT(int ai, int aj = -1);
+    int FindConflictingAgent(int v, int agent);
     bool allReached();
-    void SortAgentsById();
+
+    // Steps recorded per agent, and one agent's trajectory as (x, y, direction) steps
+    int PathLength() const;
+    std::vector<std::vector<int>> Path(int agent) const;
+    // Current (x, y, direction) of one agent
+    std::vector<int> Position(int agent) const;
 
 private:
-    std::unordered_map<Vertex *, Agent *> occupied_now;
-    std::unordered_map<Vertex *, Agent *> occupied_next;
+    // Fleet-wide trajectory buffer: row t holds every agent's step t, at t * num_agents + agent
+    std::vector<TrajectoryStep> trajectory;
+    // Active agent ids from highest to lowest priority, re-sorted every step
+    std::vector<int> order;
+    std::vector<std::pair<float, int>> ranked;
+    // Ids of removed agents, free for addAgent
+    std::vector<int> free_slots;
+    // Agent on each vertex now and the agent that has claimed it for the next
+    // step, indexed by vertex id; -1 when free
+    std::vector<int> occupied_now;
+    std::vector<int> occupied_next;
+    std::mt19937 rng;
+
+    // Moves agent's claim for the next step to vertex v (-1 to undecide)
+    void SetNext(int agent, int v);
+
+    // One timestep, split into its phases
+    void UpdatePriorities();
+    void PlanMoves();
+    void ApplyMoves();
+    // The trajectory stride is the number of agents, so a change to the fleet
+    // restarts the buffer from the current positions
+    void RestartTrajectory();
+
+    // One hop of priority inheritance: an agent, the agent it inherited from,
+    // its candidate vertices best first and the next one to try
+    struct InheritanceFrame
+    {
+        int agent;
+        int parent;
+        int count;
+        int next;
+        Vertex *candidates[5];
+    };
+    // Each frame's agent has claimed a vertex, so no agent appears twice and
+    // the depth never exceeds num_agents; reserved up front
+    std::vector<InheritanceFrame> inheritance;
+    void PushFrame(int agent, int parent);
+    // Applies the turn-in-place rule once agent has a valid move to u
+    void CommitMove(int agent, Vertex *u, bool inherited);
 
     int HeuristicDistance(const Vertex *start, const Vertex *goal);
     void PrintAgents();
@@ -0,0 +1,297 @@
+#include "lacam.h"
+
+#include <algorithm>
+#include <cmath>
+
+static int Pack(int vertex, Direction heading)
+{
+    return vertex * 5 + (int)heading;
+}
+
+lacam::lacam(int w, int h,
+             const std::vector<std::vector<int>> &starts,
+             const std::vector<std::vector<int>> &goals)
+    : num_agents(starts.size()),
+      generator(w, h, starts, goals),
+      rng(std::random_device{}())
+{
+    generator.record_trajectory = false;
+    generator.random_tie_breaking = true;
+
+    // PIBT's shuffled tie-breakers seed the priorities of the start configuration
+    start_priorities = generator.priority;
+    start_state.resize(num_agents);
+    for (int i = 0; i < num_agents; ++i)
+    {
+        start_state[i] = Pack(generator.v_now[i], generator.heading[i]);
+    }
+}
+
+size_t lacam::StateHash::operator()(const std::vector<int> &state) const
+{
+    size_t hash = state.size();
+    for (int s : state)
+    {
+        hash ^= std::hash<int>()(s) + 0x9E3779B97F4A7C15ULL + (hash << 6) + (hash >> 2);
+    }
+    return hash;
+}
+
+bool lacam::IsGoal(const std::vector<int> &state) const
+{
+    for (int i = 0; i < num_agents; ++i)
+    {
+        if (state[i] / 5 != generator.goal[i])
+            return false;
+    }
+    return true;
+}
+
+int lacam::TransitionCost(const std::vector<int> &from, const std::vector<int> &to) const
+{
+    if (objective == LACAM_MAKESPAN)
+        return 1;
+
+    // Agents resting on their goal cost nothing
+    int cost = 0;
+    for (int i = 0; i < num_agents; ++i)
+    {
+        if (from[i] / 5 != generator.goal[i] || to[i] / 5 != generator.goal[i])
+            ++cost;
+    }
+    return cost;
+}
+
+int lacam::Heuristic(const std::vector<int> &state) const
+{
+    // Distances ignore other agents and turns, so they never overestimate
+    int sum = 0;
+    int max = 0;
+    for (int i = 0; i < num_agents; ++i)
+    {
+        const Vertex *v = generator.graph.locations[state[i] / 5];
+        const Vertex *target = generator.graph.locations[generator.goal[i]];
+        int d = std::abs(v->x - target->x) + std::abs(v->y - target->y);
+        sum += d;
+        max = std::max(max, d);
+    }
+    return objective == LACAM_MAKESPAN ? max : sum;
+}
+
+lacam::HighLevelNode *lacam::CreateNode(const std::vector<int> &state, HighLevelNode *parent)
+{
+    // Every configuration starts its low-level search from the empty constraint set
+    static const LowLevelNode root{nullptr, 0, -1, -1};
+
+    nodes.emplace_back();
+    HighLevelNode *node = &nodes.back();
+    node->state = state;
+    node->parent = parent;
+    node->g = parent ? parent->g + TransitionCost(parent->state, state) : 0;
+    node->h = Heuristic(state);
+    node->search_tree.push(&root);
+    if (parent)
+        parent->neighbors.push_back(node);
+
+    // Agents away from their goal gain priority every step; one on its goal
+    // drops back to its tie-breaker, as in PIBT
+    node->priorities = parent ? parent->priorities : start_priorities;
+    for (int i = 0; parent && i < num_agents; ++i)
+    {
+        if (state[i] / 5 != generator.goal[i])
+            node->priorities[i]++;
+        else
+            node->priorities[i] -= std::floor(node->priorities[i]);
+    }
+
+    node->order.resize(num_agents);
+    for (int i = 0; i < num_agents; ++i)
+    {
+        node->order[i] = i;
+    }
+    std::sort(node->order.begin(), node->order.end(), [&](int a, int b)
+              { return node->priorities[a] > node->priorities[b]; });
+
+    explored[state] = node;
+    ++nodes_created;
+    return node;
+}
+
+void lacam::ExpandLowLevel(HighLevelNode *node, const LowLevelNode *constraint)
+{
+    // Fix the next agent in priority order to each of its moves in turn
+    int agent = node->order[constraint->depth];
+    Vertex *now = generator.graph.locations[node->state[agent] / 5];
+    Vertex *candidates[5];
+    int count = generator.graph.GetNeighbors(now, candidates);
+    candidates[count++] = now;
+    std::shuffle(candidates, candidates + count, rng);
+
+    for (int k = 0; k < count; ++k)
+    {
+        low_level_nodes.push_back({constraint, constraint->depth + 1, agent, candidates[k]->id});
+        node->search_tree.push(&low_level_nodes.back());
+    }
+}
+
+bool lacam::Successor(const HighLevelNode *node, const LowLevelNode *constraint, std::vector<int> &next)
+{
+    std::vector<int> vertices(num_agents);
+    std::vector<Direction> headings(num_agents);
+    for (int i = 0; i < num_agents; ++i)
+    {
+        vertices[i] = node->state[i] / 5;
+        headings[i] = (Direction)(node->state[i] % 5);
+    }
+
+    // Highest priority first, as the constraints were added
+    std::vector<std::pair<int, int>> constraints(constraint->depth);
+    for (const LowLevelNode *c = constraint; c->depth > 0; c = c->parent)
+    {
+        constraints[c->depth - 1] = {c->agent, c->vertex};
+    }
+
+    generator.priority = node->priorities;
+    if (!generator.StepFrom(vertices, headings, constraints))
+        return false;
+
+    next.resize(num_agents);
+    for (int i = 0; i < num_agents; ++i)
+    {
+        next[i] = Pack(generator.v_now[i], generator.heading[i]);
+    }
+    ++successors_generated;
+    return true;
+}
+
+void lacam::run()
+{
+    auto started = std::chrono::steady_clock::now();
+    auto deadline = started + time_limit;
+    nodes.clear();
+    low_level_nodes.clear();
+    explored.clear();
+    solution.clear();
+    improvements.clear();
+    failed = false;
+    optimal = false;
+    cost = 0;
+    nodes_created = 0;
+    successors_generated = 0;
+
+    // The cheapest goal configuration so far; configurations differ in headings,
+    // so there may be several
+    HighLevelNode *goal_node = nullptr;
+    auto offer_goal = [&](HighLevelNode *node)
+    {
+        if (!IsGoal(node->state) || (goal_node && node->g >= goal_node->g))
+            return;
+        goal_node = node;
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - started;
+        improvements.push_back({elapsed.count(), node->g});
+    };
+
+    // Depth-first: the newest configuration is always tried next
+    HighLevelNode *start_node = CreateNode(start_state, nullptr);
+    std::vector<HighLevelNode *> open = {start_node};
+    offer_goal(start_node);
+    std::uniform_real_distribution<double> restart(0.0, 1.0);
+    std::vector<int> next;
+    std::queue<HighLevelNode *> rewire;
+
+    while (!open.empty() && (anytime || !goal_node))
+    {
+        if (time_limit.count() > 0 && std::chrono::steady_clock::now() > deadline)
+            break;
+
+        // Once a solution is in hand, restart from the start configuration now
+        // and then, so refinement is not confined to the branch that found it
+        if (goal_node && restart(rng) < 0.001)
+            open.push_back(start_node);
+
+        HighLevelNode *node = open.back();
+
+        // Nothing below this configuration can beat the solution in hand, or
+        // every successor of it has been tried
+        if ((goal_node && node->g + node->h >= goal_node->g) || node->search_tree.empty())
+        {
+            open.pop_back();
+            continue;
+        }
+
+        const LowLevelNode *constraint = node->search_tree.front();
+        node->search_tree.pop();
+        if (constraint->depth < num_agents)
+            ExpandLowLevel(node, constraint);
+
+        if (!Successor(node, constraint, next))
+            continue;
+
+        auto found = explored.find(next);
+        if (found == explored.end())
+        {
+            open.push_back(CreateNode(next, node));
+            offer_goal(open.back());
+            continue;
+        }
+
+        HighLevelNode *known = found->second;
+        open.push_back(known);
+        if (!anytime)
+            continue;
+
+        // LaCAM*: a new edge into a known configuration may give it, and
+        // everything reached through it, a cheaper parent
+        if (std::find(node->neighbors.begin(), node->neighbors.end(), known) == node->neighbors.end())
+            node->neighbors.push_back(known);
+        rewire.push(node);
+        while (!rewire.empty())
+        {
+            HighLevelNode *from = rewire.front();
+            rewire.pop();
+            for (HighLevelNode *to : from->neighbors)
+            {
+                int g = from->g + TransitionCost(from->state, to->state);
+                if (g >= to->g)
+                    continue;
+                to->g = g;
+                to->parent = from;
+                rewire.push(to);
+                offer_goal(to);
+                if (goal_node && g + to->h < goal_node->g)
+                    open.push_back(to);
+            }
+        }
+    }
+
+    if (!goal_node)
+    {
+        failed = true;
+        return;
+    }
+
+    // An exhausted search has ruled out anything cheaper
+    optimal = anytime && open.empty();
+    cost = goal_node->g;
+    for (const HighLevelNode *node = goal_node; node; node = node->parent)
+    {
+        solution.push_back(node->state);
+    }
+    std::reverse(solution.begin(), solution.end());
+}
+
+int lacam::PathLength() const
+{
+    return solution.size();
+}
+
+std::vector<std::vector<int>> lacam::Path(int agent) const
+{
+    std::vector<std::vector<int>> path;
+    for (const auto &state : solution)
+    {
+        const Vertex *v = generator.graph.locations[state[agent] / 5];
+        path.push_back({v->x, v->y, state[agent] % 5});
+    }
+    return path;
+}
@@ -1,6 +1,7 @@
 #include "pibt_alg.h"
 
 #include <algorithm>
+#include <cmath>
 #include <iostream>
 #include <random>
 
@@ -13,10 +14,12 @@ pibt::pibt(int w, int h,
            const std::vector<std::vector<int>> &starts,
            const std::vector<std::vector<int>> &goals)
     : graph(w, h),
-      agents()
+      num_agents(starts.size()),
+      occupied_now(graph.locations.size(), -1),
+      occupied_next(graph.locations.size(), -1),
+      rng(std::random_device{}())
 {
     // Create a list of unique priorities
-    const int num_agents = starts.size();
     std::vector<float> priorities(num_agents);
 
     // Initialize priorities with evenly spaced values
@@ -26,258 +29,332 @@ pibt::pibt(int w, int h,
     }
 
     // Shuffle priorities to ensure randomness
-    std::random_device rd;
-    std::mt19937 g(rd());
-    std::shuffle(priorities.begin(), priorities.end(), g);
+    std::shuffle(priorities.begin(), priorities.end(), rng);
+
+    v_now.resize(num_agents);
+    v_next.assign(num_agents, -1);
+    goal.resize(num_agents);
+    priority = priorities;
+    heading.resize(num_agents);
+    reached_goal.assign(num_agents, false);
+    order.resize(num_agents);
+    inheritance.reserve(num_agents);
+    // Every trajectory starts with its start twice
+    trajectory.resize(2 * num_agents);
 
     for (int i = 0; i < num_agents; ++i)
     {
         const auto &start = starts[i];
-        const auto &goal = goals[i];
-        Vertex *start_vertex = nullptr;
-        Vertex *goal_vertex = nullptr;
-
-        for (Vertex *v : graph.locations)
-        {
-            if (v->x == start[0] && v->y == start[1])
-            {
-                start_vertex = v;
-            }
-            if (v->x == goal[0] && v->y == goal[1])
-            {
-                goal_vertex = v;
-            }
-        }
+        const Vertex *start_vertex = graph.GetVertex(start[0], start[1]);
+        const Vertex *goal_vertex = graph.GetVertex(goals[i][0], goals[i][1]);
 
         if (!start_vertex || !goal_vertex)
         {
             throw std::runtime_error("Invalid start or goal location.");
         }
 
-        Agent *agent = new Agent(
-            (int)(i),            // id
-            start_vertex,        // current location
-            nullptr,             // next location
-            start_vertex,        // start
-            goal_vertex,         // goal
-            priorities[i],       // unique priority
-            false,               // reached goal
-            (Direction)start[2] // initialize current direction
-        );
-        agents.push_back(agent);
+        v_now[i] = start_vertex->id;
+        goal[i] = goal_vertex->id;
+        heading[i] = (Direction)start[2];
+        order[i] = i;
+        occupied_now[start_vertex->id] = i;
+        trajectory[i] = trajectory[num_agents + i] = {start_vertex->id, start_vertex->direction};
     }
 }
 
-pibt::~pibt()
+int pibt::FindConflictingAgent(int v, int agent)
 {
-    for (Agent *agent : agents)
-    {
-        delete agent;
-    }
+    int ak = occupied_now[v];
+    if (ak != -1 && v_next[ak] == -1 && ak != agent)
+        return ak;
+    return -1;
 }
 
-Agent *pibt::FindConflictingAgent(const Vertex *v, const Agent *agent)
+void pibt::SetNext(int agent, int v)
 {
-    for (auto ak : agents)
-    {
-        if (ak->v_now == v && ak->v_next == nullptr && ak->id != agent->id)
-        {
-            return ak;
-        }
-    }
-    return nullptr;
+    // A claim is only released by its owner; another agent may have taken the slot over
+    if (v_next[agent] != -1 && occupied_next[v_next[agent]] == agent)
+        occupied_next[v_next[agent]] = -1;
+    v_next[agent] = v;
+    if (v != -1)
+        occupied_next[v] = agent;
 }
 
 bool pibt::allReached()
 {
-    for (auto agent : agents)
+    for (char reached : reached_goal)
     {
-        if (!agent->reached_goal)
+        if (!reached)
             return false;
     }
     return true;
 }
 
+int pibt::PathLength() const
+{
+    return num_agents ? trajectory.size() / num_agents : 0;
+}
+
+std::vector<int> pibt::Position(int agent) const
+{
+    const Vertex *v = graph.locations[v_now[agent]];
+    return {v->x, v->y, (int)heading[agent]};
+}
+
+std::vector<std::vector<int>> pibt::Path(int agent) const
+{
+    std::vector<std::vector<int>> path;
+    for (int t = 0; t < PathLength(); ++t)
+    {
+        const TrajectoryStep &step = trajectory[t * num_agents + agent];
+        const Vertex *v = graph.locations[step.vertex];
+        path.push_back({v->x, v->y, (int)step.direction});
+    }
+    return path;
+}
+
 void pibt::PrintAgents()
 {
-    for (auto agent : agents)
+    for (int i = 0; i < num_agents; ++i)
     {
-        std::cout << "Agent ID: " << agent->id << '\n';
-        std::cout << "Current Location: (" << agent->v_now->x << ", " << agent->v_now->y << ")\n";
+        const Vertex *now = graph.locations[v_now[i]];
+        const Vertex *target = graph.locations[goal[i]];
+        std::cout << "Agent ID: " << i << '\n';
+        std::cout << "Current Location: (" << now->x << ", " << now->y << ")\n";
         std::cout << "Next Location: ";
-        if (agent->v_next)
+        if (v_next[i] != -1)
         {
-            std::cout << "(" << agent->v_next->x << ", " << agent->v_next->y << ")\n";
+            const Vertex *next = graph.locations[v_next[i]];
+            std::cout << "(" << next->x << ", " << next->y << ")\n";
         }
         else
         {
             std::cout << "None\n";
         }
-        std::cout << "Goal Location: (" << agent->goal->x << ", " << agent->goal->y << ")\n";
-        std::cout << "Priority: " << agent->priority << '\n';
-        std::cout << "Reached Goal: " << (agent->reached_goal ? "Yes" : "No") << '\n';
+        std::cout << "Goal Location: (" << target->x << ", " << target->y << ")\n";
+        std::cout << "Priority: " << priority[i] << '\n';
+        std::cout << "Reached Goal: " << (reached_goal[i] ? "Yes" : "No") << '\n';
     }
 }
 
-void pibt::SortAgentsById()
-{
-    std::sort(agents.begin(), agents.end(), [](const Agent *a, const Agent *b)
-              { return a->id < b->id; });
-}
-
-// Function to determine next move for an agent
-bool pibt::PIBT(Agent *ai, Agent *aj)
+void pibt::PushFrame(int agent, int parent)
 {
+    const Vertex *target = graph.locations[goal[agent]];
     auto compare = [&](Vertex *const v, Vertex *const u)
     {
-        int d_v = HeuristicDistance(v, ai->goal);
-        int d_u = HeuristicDistance(u, ai->goal);
+        int d_v = HeuristicDistance(v, target);
+        int d_u = HeuristicDistance(u, target);
         return d_v < d_u;
     };
 
-    std::vector<Vertex *> candidates = graph.GetNeighbors(ai->v_now);
-    candidates.push_back(ai->v_now); // Include current vertex as a candidate
-    std::sort(candidates.begin(), candidates.end(), compare);
+    Vertex *now = graph.locations[v_now[agent]];
+    inheritance.emplace_back();
+    InheritanceFrame &frame = inheritance.back();
+    frame.agent = agent;
+    frame.parent = parent;
+    frame.next = 0;
+    frame.count = graph.GetNeighbors(now, frame.candidates);
+    frame.candidates[frame.count++] = now; // Include current vertex as a candidate
+    if (random_tie_breaking)
+        std::shuffle(frame.candidates, frame.candidates + frame.count, rng);
+    std::sort(frame.candidates, frame.candidates + frame.count, compare);
+}
+
+void pibt::CommitMove(int agent, Vertex *u, bool inherited)
+{
+    const Vertex *now = graph.locations[v_now[agent]];
+    int dx = now->x - u->x;
+    int dy = now->y - u->y;
+    bool moving_side = (heading[agent] == 0 || heading[agent] == 1) && dx;
+    bool moving_side_up = (heading[agent] == 2 || heading[agent] == 3) && dy;
+
+    if (inherited || moving_side || moving_side_up)
+    {
+        SetNext(agent, v_now[agent]);
+        if (moving_side || moving_side_up)
+            heading[agent] = u->direction;
+    }
+}
+
+// Function to determine next move for an agent
+bool pibt::PIBT(int ai, int aj)
+{
+    inheritance.clear();
+    PushFrame(ai, aj);
+
+    // Result of the frame just popped, handed to the frame below it
+    bool result = false;
+    bool returning = false;
 
-    for (Vertex *u : candidates)
+    while (!inheritance.empty())
     {
-        bool vertex_conflict = false;
-        for (auto ak : agents)
+        InheritanceFrame &frame = inheritance.back();
+        int agent = frame.agent;
+
+        if (returning)
         {
-            if (ak->id == ai->id)
-                continue;
-            if (ak->v_next != nullptr)
+            // The agent on our chosen vertex has answered
+            returning = false;
+            Vertex *u = frame.candidates[frame.next - 1];
+            if (result)
             {
-                if (ak->v_next == u)
-                {
-                    vertex_conflict = true;
-                    break;
-                }
-                if (ak->v_now == u)
-                {
-                    vertex_conflict = true;
-                    break;
-                }
+                CommitMove(agent, u, true);
+                inheritance.pop_back();
+                returning = true;
+                continue;
             }
+            SetNext(agent, -1);
         }
 
-        if (vertex_conflict || (aj && aj->v_now == u))
+        bool descended = false;
+        bool moved = false;
+        while (frame.next < frame.count)
         {
-            continue;
-        }
+            Vertex *u = frame.candidates[frame.next++];
 
-        ai->v_next = u;
-        bool found_valid_move = true;
-        bool inherited = false;
+            // Taken for the next step, or held by an agent that has already decided
+            int claimed = occupied_next[u->id];
+            int holder = occupied_now[u->id];
+            bool vertex_conflict = (claimed != -1 && claimed != agent) ||
+                                   (holder != -1 && holder != agent && v_next[holder] != -1);
 
-        for (auto ak : agents)
-        {
-            if (ak->id == ai->id)
+            if (vertex_conflict || (frame.parent != -1 && v_now[frame.parent] == u->id))
+            {
                 continue;
+            }
 
-            if (!(ak->v_now == u))
-                continue;
-            if (ak->v_next != nullptr)
-                continue;
+            SetNext(agent, u->id);
 
-            if (PIBT(ak, ai))
-            {
-                inherited = true;
-            }
-            else
+            // An undecided agent on u must make way
+            int ak = FindConflictingAgent(u->id, agent);
+            if (ak != -1)
             {
-                found_valid_move = false;
+                PushFrame(ak, agent);
+                descended = true;
+                break;
             }
 
-            // break;
+            CommitMove(agent, u, false);
+            moved = true;
+            break;
         }
 
-        if (!found_valid_move)
-        {
-            // ai->v_next = ai->v_now;
-            ai->v_next = nullptr;
+        if (descended)
             continue;
-        }
-
-        int dx = ai->v_now->x - u->x;
-        int dy = ai->v_now->y - u->y;
-        bool moving_side = (ai->current_direction == 0 || ai->current_direction == 1) && dx;
-        bool moving_side_up = (ai->current_direction == 2 || ai->current_direction == 3) && dy;
-
-        if ((found_valid_move && inherited) || moving_side || moving_side_up)
-        {
-            ai->v_next = ai->v_now;
-            if (moving_side || moving_side_up)
-                ai->current_direction = u->direction;
-        }
 
-        return found_valid_move;
+        if (!moved)
+            SetNext(agent, v_now[agent]);
+        result = moved;
+        inheritance.pop_back();
+        returning = true;
     }
 
-    ai->v_next = ai->v_now;
+    return result;
+}
 
-    return false;
+void pibt::UpdatePriorities()
+{
+    for (int i : order)
+    {
+        if (v_now[i] != goal[i])
+            priority[i]++;
+        else
+            reached_goal[i] = true;
+    }
 }
 
-void pibt::run()
+void pibt::PlanMoves()
 {
-    auto compare = [](Agent *a, const Agent *b)
+    // Sort keys gathered from the priority array, so the sort runs over contiguous pairs
+    ranked.resize(order.size());
+    for (int k = 0; k < order.size(); ++k)
     {
-        return a->priority > b->priority;
-    };
+        ranked[k] = {priority[order[k]], order[k]};
+    }
+    std::sort(ranked.begin(), ranked.end(), [](const std::pair<float, int> &a, const std::pair<float, int> &b)
+              { return a.first > b.first; });
+    for (int k = 0; k < order.size(); ++k)
+    {
+        order[k] = ranked[k].second;
+    }
 
-    while (!allReached())
+    for (int agent : order)
     {
-        for (auto *agent : agents)
+        if (v_next[agent] == -1)
         {
-            if (!(agent->v_now == agent->goal))
-                agent->priority++;
-            else
-                agent->reached_goal = true;
-
-            if (agent->v_next != nullptr)
-            {
-                Direction new_direction = Direction::None;
-                if (agent->v_next->x == agent->v_now->x && agent->v_next->y == agent->v_now->y - 1)
-                    new_direction = Direction::Up;
-                else if (agent->v_next->x == agent->v_now->x && agent->v_next->y == agent->v_now->y + 1)
-                    new_direction = Direction::Down;
-                else if (agent->v_next->x == agent->v_now->x - 1 && agent->v_next->y == agent->v_now->y)
-                    new_direction = Direction::Left;
-                else if (agent->v_next->x == agent->v_now->x + 1 && agent->v_next->y == agent->v_now->y)
-                    new_direction = Direction::Right;
-
-                // Maintain direction consistency for opposite moves
-                if ((new_direction == Direction::Up && agent->current_direction == Direction::Down) ||
-                    (new_direction == Direction::Down && agent->current_direction == Direction::Up) ||
-                    (new_direction == Direction::Left && agent->current_direction == Direction::Right) ||
-                    (new_direction == Direction::Right && agent->current_direction == Direction::Left) ||
-                    (new_direction == Direction::None))
-                {
-                    new_direction = agent->current_direction;
-                }
-
-                agent->Path.push_back({agent->v_next->x, agent->v_next->y, (int) new_direction});
-                agent->current_direction = new_direction; // Update previous direction
-                agent->v_now = agent->v_next;
-                agent->v_next = nullptr;
-            }
+            PIBT(agent);
         }
+    }
+}
 
-        std::sort(agents.begin(), agents.end(), compare);
+void pibt::ApplyMoves()
+{
+    // Each step appends one row to the trajectory buffer
+    size_t row = trajectory.size();
+    if (record_trajectory)
+        trajectory.resize(row + num_agents);
 
-        for (auto *agent : agents)
+    for (int i = 0; i < num_agents; ++i)
+    {
+        if (v_next[i] == -1)
         {
-            if (agent->v_next == nullptr)
-            {
-                PIBT(agent, nullptr);
-            }
+            // Removed agents, and nobody else after a full PIBT pass, keep their place
+            if (record_trajectory)
+                trajectory[row + i] = {v_now[i], heading[i]};
+            continue;
         }
+
+        const Vertex *now = graph.locations[v_now[i]];
+        const Vertex *next = graph.locations[v_next[i]];
+        Direction new_direction = Direction::None;
+        if (next->x == now->x && next->y == now->y - 1)
+            new_direction = Direction::Up;
+        else if (next->x == now->x && next->y == now->y + 1)
+            new_direction = Direction::Down;
+        else if (next->x == now->x - 1 && next->y == now->y)
+            new_direction = Direction::Left;
+        else if (next->x == now->x + 1 && next->y == now->y)
+            new_direction = Direction::Right;
+
+        // Maintain direction consistency for opposite moves
+        if ((new_direction == Direction::Up && heading[i] == Direction::Down) ||
+            (new_direction == Direction::Down && heading[i] == Direction::Up) ||
+            (new_direction == Direction::Left && heading[i] == Direction::Right) ||
+            (new_direction == Direction::Right && heading[i] == Direction::Left) ||
+            (new_direction == Direction::None))
+        {
+            new_direction = heading[i];
+        }
+
+        if (record_trajectory)
+            trajectory[row + i] = {v_next[i], new_direction};
+        heading[i] = new_direction; // Update previous direction
+        if (occupied_now[v_now[i]] == i)
+            occupied_now[v_now[i]] = -1;
+        v_now[i] = v_next[i];
+        occupied_now[v_now[i]] = i;
+        SetNext(i, -1);
+    }
+}
+
+void pibt::run()
+{
+    // Moves are applied at the top of the next round, after priorities have
+    // seen the positions they were planned from
+    bool decided = false;
+
+    while (!allReached())
+    {
+        UpdatePriorities();
+        if (decided)
+            ApplyMoves();
+        PlanMoves();
+        decided = true;
         ++timesteps;
 
         timesteps++;
 
-        if (timesteps > (agents.size() * std::max(graph.width, graph.height) * 10))
+        if (timesteps > (num_agents * std::max(graph.width, graph.height) * 10))
         {
             failed = true;
             timesteps = 0;
@@ -285,3 +362,142 @@ void pibt::run()
         }
     }
 }
+
+void pibt::step()
+{
+    UpdatePriorities();
+    PlanMoves();
+    ApplyMoves();
+    ++timesteps;
+}
+
+void pibt::setGoal(int agent, int x, int y)
+{
+    const Vertex *goal_vertex = graph.GetVertex(x, y);
+    if (!goal_vertex)
+    {
+        throw std::runtime_error("Invalid goal location.");
+    }
+
+    goal[agent] = goal_vertex->id;
+    reached_goal[agent] = false;
+    // A new task starts from the agent's tie-breaker, as in lifelong PIBT
+    priority[agent] -= std::floor(priority[agent]);
+}
+
+int pibt::addAgent(const std::vector<int> &start, const std::vector<int> &goal_location)
+{
+    const Vertex *start_vertex = graph.GetVertex(start[0], start[1]);
+    const Vertex *goal_vertex = graph.GetVertex(goal_location[0], goal_location[1]);
+    if (!start_vertex || !goal_vertex)
+    {
+        throw std::runtime_error("Invalid start or goal location.");
+    }
+    if (occupied_now[start_vertex->id] != -1 || occupied_next[start_vertex->id] != -1)
+    {
+        throw std::runtime_error("Start location is occupied.");
+    }
+
+    int agent;
+    if (!free_slots.empty())
+    {
+        agent = free_slots.back();
+        free_slots.pop_back();
+    }
+    else
+    {
+        agent = num_agents++;
+        v_now.push_back(-1);
+        v_next.push_back(-1);
+        goal.push_back(-1);
+        priority.push_back(0.0f);
+        heading.push_back(Direction::None);
+        reached_goal.push_back(false);
+        inheritance.reserve(num_agents);
+    }
+
+    v_now[agent] = start_vertex->id;
+    v_next[agent] = -1;
+    goal[agent] = goal_vertex->id;
+    priority[agent] = std::uniform_real_distribution<float>(0.0f, 1.0f)(rng);
+    heading[agent] = (Direction)start[2];
+    reached_goal[agent] = false;
+    occupied_now[start_vertex->id] = agent;
+    order.push_back(agent);
+
+    RestartTrajectory();
+    return agent;
+}
+
+void pibt::removeAgent(int agent)
+{
+    auto it = std::find(order.begin(), order.end(), agent);
+    if (it == order.end())
+        return;
+    order.erase(it);
+
+    SetNext(agent, -1);
+    if (occupied_now[v_now[agent]] == agent)
+        occupied_now[v_now[agent]] = -1;
+    // A removed agent never holds up allReached()
+    reached_goal[agent] = true;
+    free_slots.push_back(agent);
+
+    RestartTrajectory();
+}
+
+void pibt::RestartTrajectory()
+{
+    trajectory.resize(num_agents);
+    for (int i = 0; i < num_agents; ++i)
+    {
+        trajectory[i] = {v_now[i], heading[i]};
+    }
+}
+
+bool pibt::StepFrom(const std::vector<int> &vertices, const std::vector<Direction> &headings,
+                    const std::vector<std::pair<int, int>> &constraints)
+{
+    for (int i = 0; i < num_agents; ++i)
+    {
+        SetNext(i, -1);
+        if (occupied_now[v_now[i]] == i)
+            occupied_now[v_now[i]] = -1;
+    }
+    for (int i = 0; i < num_agents; ++i)
+    {
+        v_now[i] = vertices[i];
+        heading[i] = headings[i];
+        occupied_now[v_now[i]] = i;
+    }
+
+    for (const auto &[agent, v] : constraints)
+    {
+        const Vertex *now = graph.locations[v_now[agent]];
+        const Vertex *u = graph.locations[v];
+        int dx = u->x - now->x;
+        int dy = u->y - now->y;
+        bool moving_side = (heading[agent] == 0 || heading[agent] == 1) && dx;
+        bool moving_side_up = (heading[agent] == 2 || heading[agent] == 3) && dy;
+
+        // Same moves as PIBT: a turn towards u keeps the agent in place, and
+        // it only enters a vertex nobody stands on
+        int next = v;
+        if (moving_side || moving_side_up)
+            next = v_now[agent];
+        else if (v != v_now[agent] && occupied_now[v] != -1)
+            return false;
+        if (occupied_next[next] != -1)
+            return false;
+
+        SetNext(agent, next);
+        if (moving_side)
+            heading[agent] = dx < 0 ? Direction::Left : Direction::Right;
+        else if (moving_side_up)
+            heading[agent] = dy < 0 ? Direction::Up : Direction::Down;
+    }
+
+    PlanMoves();
+    ApplyMoves();
+    return true;
+}
@@ -30,7 +30,9 @@ public:
     CBS_Robot();
     CBS_Robot(glm::vec2 pos, float radius, glm::vec2 velocity, Texture2D sprite, glm::vec3 color);
     void Rotate(float dt);
-    void Move(float dt, float unit_width, float unit_height, bool AllRobotsReached = false, bool AllRobotsRotated = false);
+    void Move(float dt, float unit_width, float unit_height, bool MayAdvance = false);
+    // Index of the last path step the robot has arrived at
+    int CompletedSteps() const;
     void Reset(glm::vec2 position, glm::vec2 velocity);
     void Draw(SpriteRenderer &renderer);
     glm::vec2 GetPosition();
@@ -6,12 +6,22 @@
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
+#include <chrono>
+#include <memory>
 
 const glm::vec2 INITIAL_VELOCITY(800.0f, 800.0f);
 const float RADIUS = 30.0f;
 #define ROWS 6
 #define COLS 6
 #define NUMBER_OF_ROBOTS 6
+// Wall-clock budget for planning one instance
+const std::chrono::milliseconds PLANNING_BUDGET(200);
+// Constraint tree memory allowed for planning one instance
+const std::size_t PLANNING_MEMORY_LIMIT = 64 << 20;
+// Plans tolerate any robot running this many steps behind the others
+#define ROBUSTNESS 2
+
+class Cbs;
 
 class CBS_Sim
 {
@@ -27,12 +37,15 @@ public:
     void Render();
     void Clear();
 
-    bool AllReached();
-    bool AllRotated();
+    // Whether robot may head for its next step: no unfinished robot would
+    // lag more than ROBUSTNESS steps behind it
+    bool MayAdvance(const CBS_Robot *robot);
     bool AllReachedGoal();
 
 private:
     std::vector<CBS_Robot *> Robots;
+    // Kept across Init calls so that its path cache carries over between instances
+    std::unique_ptr<Cbs> Planner;
 };
 
 #endif // CBS_Sim
\ No newline at end of file
@@ -3,7 +3,6 @@
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
-#include <set>
 #include "pibt_alg.h"
 #include "grid.h"
 #include "pibt_robot.h"
@@ -13,6 +12,8 @@ const float RADIUS = 30.0f;
 #define ROWS 6
 #define COLS 6
 #define NUMBER_OF_ROBOTS 25
+// Steps the planner runs ahead of the robots, so a wiggle can be smoothed out before it is driven
+#define PLAN_AHEAD 2
 
 class PIBT_Sim
 {
@@ -21,7 +22,6 @@ public:
     float UnitWidth, UnitHeight;
     Grid grid;
     int globalPathIndex = 1;
-    int path_size;
     std::vector<std::vector<int>> starts;
     std::vector<std::vector<int>> goals;
 
@@ -32,10 +32,11 @@ public:
     void Render();
     void Clear();
 
-    bool StateChanged();
-    void Replan();
-
-    std::vector<std::vector<std::vector<int>>> CleanSolution(const std::vector<std::vector<std::vector<int>>> &solution);
+    // Advances the lifelong planner one step and extends every robot's path
+    void PlanStep();
+    // Hands a new goal to every agent the planner has brought to its goal
+    void AssignGoals();
+    void SmoothPathTail(std::vector<std::vector<int>> &path);
 
     bool AllReached();
     bool AllRotated();
@@ -43,7 +44,8 @@ public:
 
 private:
     std::vector<PIBT_Robot *> Robots;
-    std::set<int> idle_robots;
+    // One planner for the whole run; goals change in place
+    pibt *planner = nullptr;
 };
 
 #endif // PIBT_SIM
@@ -77,7 +77,7 @@ void CBS_Robot::Rotate(float dt)
     }
 }
 
-void CBS_Robot::Move(float dt, float unit_width, float unit_height, bool AllRobotsReached, bool AllRobotsRotated)
+void CBS_Robot::Move(float dt, float unit_width, float unit_height, bool MayAdvance)
 {
     if (!this->isMoving)
         return;
@@ -92,7 +92,7 @@ void CBS_Robot::Move(float dt, float unit_width, float unit_height, bool AllRobo
 
     reached = glm::distance(this->CurrentPosition, targetPosition) < 1.0f;
 
-    if (reached && AllRobotsReached && AllRobotsRotated)
+    if (reached && MayAdvance)
     {
         this->isRotating = true;
         this->isMoving = false;
@@ -149,6 +149,11 @@ void CBS_Robot::Move(float dt, float unit_width, float unit_height, bool AllRobo
     this->CurrentPosition += movement;
 }
 
+int CBS_Robot::CompletedSteps() const
+{
+    return reached ? currentPathIndex : currentPathIndex - 1;
+}
+
 void CBS_Robot::Reset(glm::vec2 position, glm::vec2 velocity)
 {
     this->CurrentPosition = position;
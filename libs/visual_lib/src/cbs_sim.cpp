@@ -60,56 +60,66 @@ void CBS_Sim::Init()
         glm::vec2((0.0f * UnitWidth) + UnitWidth / 2 - RADIUS, (2.0f * UnitHeight) + UnitHeight / 2 - RADIUS),
         glm::vec2((0.0f * UnitWidth) + UnitWidth / 2 - RADIUS, (1.0f * UnitHeight) + UnitHeight / 2 - RADIUS)};
 
-    auto endpoints = GenerateEndpoints(NUMBER_OF_ROBOTS, ROWS, COLS);
+    std::vector<std::vector<int>> Grid(ROWS, std::vector<int>(COLS, 1));
 
-    std::vector<std::vector<int>> start_vecs = endpoints[0];
-    std::vector<std::vector<int>> goal_vecs = endpoints[1];
+    if (!Planner)
+    {
+        Planner = std::make_unique<Cbs>(Grid);
+        Planner->robustness = ROBUSTNESS;
+        Planner->memory_limit = PLANNING_MEMORY_LIMIT;
+    }
 
     std::vector<std::pair<int, int>> start_pairs, goal_pairs;
+    std::vector<std::vector<std::vector<int>>> solution;
 
-    start_pairs.resize(start_vecs.size());
-    goal_pairs.resize(goal_vecs.size());
+    // Draw instances until one is solved within the planning budget
+    while (solution.empty())
+    {
+        auto endpoints = GenerateEndpoints(NUMBER_OF_ROBOTS, ROWS, COLS);
 
-    for (int i = 0; i < start_vecs.size() && goal_vecs.size(); i++){
-        start_pairs[i].first = start_vecs[i][0];
-        start_pairs[i].second = start_vecs[i][1];
+        std::vector<std::vector<int>> start_vecs = endpoints[0];
+        std::vector<std::vector<int>> goal_vecs = endpoints[1];
 
-        goal_pairs[i].first = goal_vecs[i][0];
-        goal_pairs[i].second = goal_vecs[i][1];
-    }
-    
-    std::vector<std::vector<int>> Grid(ROWS, std::vector<int>(COLS, 1));
+        start_pairs.resize(start_vecs.size());
+        goal_pairs.resize(goal_vecs.size());
 
-    Cbs cbsAlgorithm(Grid);
+        for (int i = 0; i < start_vecs.size() && goal_vecs.size(); i++){
+            start_pairs[i].first = start_vecs[i][0];
+            start_pairs[i].second = start_vecs[i][1];
 
-    auto paths = cbsAlgorithm.HighLevel(start_pairs, goal_pairs, false);
+            goal_pairs[i].first = goal_vecs[i][0];
+            goal_pairs[i].second = goal_vecs[i][1];
+        }
 
-    if(!paths.has_value())
-    {
-        std::cout << "TIMED OUT!!!!." << std::endl;
-        Clear();
-        Init();
-    }else{
+        auto result = Planner->AnytimeHighLevel(start_pairs, goal_pairs, PLANNING_BUDGET);
 
-        auto solution = paths.value();
-        for (int i = 0; i < NUMBER_OF_ROBOTS; ++i)
+        if (!result.solved)
         {
-            glm::vec2 InitialPosition = glm::vec2(((float)solution[i][0][0] * UnitWidth) + UnitWidth / 2 - RADIUS, ((float)solution[i][0][1] * UnitHeight) + UnitHeight / 2 - RADIUS);
-            glm::vec3 robotColor = glm::vec3((float)rand() / RAND_MAX, (float)rand() / RAND_MAX, (float)rand() / RAND_MAX);
-            Robots.push_back(new CBS_Robot(InitialPosition, RADIUS, INITIAL_VELOCITY, ResourceManager::GetTexture("robot"), robotColor));
-            Robots[i]->Path = solution[i];
+            std::cout << "TIMED OUT!!!!. " << result.conflicts << " conflicts left, lower bound " << result.lower_bound << std::endl;
+            continue;
+        }
+        std::cout << "Solution found with total cost: " << result.cost << std::endl;
+        std::cout << "Path cache: " << Planner->path_cache.Hits() << " hits, " << Planner->path_cache.Misses() << " misses" << std::endl;
+        std::cout << "Constraint tree memory: " << result.memory_bytes << " bytes" << std::endl;
+        solution = result.paths;
+    }
 
-            glm::vec2 goalPosition = glm::vec2((float) goal_pairs[i].first * UnitWidth, (float) goal_pairs[i].second * UnitHeight);
-            grid.SetDestinationColor(goalPosition, robotColor);
+    for (int i = 0; i < NUMBER_OF_ROBOTS; ++i)
+    {
+        glm::vec2 InitialPosition = glm::vec2(((float)solution[i][0][0] * UnitWidth) + UnitWidth / 2 - RADIUS, ((float)solution[i][0][1] * UnitHeight) + UnitHeight / 2 - RADIUS);
+        glm::vec3 robotColor = glm::vec3((float)rand() / RAND_MAX, (float)rand() / RAND_MAX, (float)rand() / RAND_MAX);
+        Robots.push_back(new CBS_Robot(InitialPosition, RADIUS, INITIAL_VELOCITY, ResourceManager::GetTexture("robot"), robotColor));
+        Robots[i]->Path = solution[i];
 
-            for (const auto &step : Robots[i]->Path)
-            {
-                std::cout << "(" << step[0] << ", " << step[1] << ", " << step[2] << ", " << step[3] << ") ";
-            }
-            std::cout << std::endl;
+        glm::vec2 goalPosition = glm::vec2((float) goal_pairs[i].first * UnitWidth, (float) goal_pairs[i].second * UnitHeight);
+        grid.SetDestinationColor(goalPosition, robotColor);
+
+        for (const auto &step : Robots[i]->Path)
+        {
+            std::cout << "(" << step[0] << ", " << step[1] << ", " << step[2] << ", " << step[3] << ") ";
         }
+        std::cout << std::endl;
     }
-
 }
 
 void CBS_Sim::Update(float dt)
@@ -124,9 +134,7 @@ void CBS_Sim::Update(float dt)
             }
             else
             {
-                bool allReached = AllReached();
-                bool allRotated = AllRotated();
-                robot->Move(dt, this->UnitWidth, this->UnitHeight, allReached, allRotated);
+                robot->Move(dt, this->UnitWidth, this->UnitHeight, MayAdvance(robot));
             }
         }else{
             robot->reachedGoal = true;
@@ -140,21 +148,13 @@ void CBS_Sim::Update(float dt)
     }
 }
 
-bool CBS_Sim::AllReached()
+bool CBS_Sim::MayAdvance(const CBS_Robot *robot)
 {
-    for (auto robot : Robots)
-    {
-        if (!robot->reached && robot->currentPathIndex < robot->Path.size())
-            return false;
-    }
-
-    return true;
-}
-bool CBS_Sim::AllRotated()
-{
-    for (auto robot : Robots)
+    // The plan is k-robust, so robots run on their own as long as none falls more than k steps behind
+    int next = robot->currentPathIndex + 1;
+    for (auto other : Robots)
     {
-        if (!robot->rotated && robot->currentPathIndex < robot->Path.size())
+        if (other->currentPathIndex < other->Path.size() && next - other->CompletedSteps() > ROBUSTNESS)
             return false;
     }
 
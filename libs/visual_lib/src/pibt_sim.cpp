@@ -11,8 +11,6 @@ SpriteRenderer *Renderer;
 std::vector<glm::vec2> InitialPositions;
 std::vector<glm::vec3> RobotsColors;
 
-using CostPath = std::vector<std::vector<int>>;
-
 PIBT_Sim::PIBT_Sim(unsigned int width, unsigned int height)
     : Width(width), Height(height)
 {
@@ -32,8 +30,9 @@ void PIBT_Sim::Clear()
         delete robot;
     }
     Robots.clear();
+    delete planner;
+    planner = nullptr;
     globalPathIndex = 1;
-    idle_robots.clear();
 }
 
 void PIBT_Sim::Init()
@@ -74,75 +73,31 @@ void PIBT_Sim::Init()
         std::cout << "Start: (" << starts[i][0] << ", " << starts[i][1] << ", " << starts[i][2] << ")---" << "Gaol: (" << goals[i][0] << ", " << goals[i][1] << ", " << goals[i][2] << ")" << std::endl;
     }
 
-    // Create a PIBT planner
-    pibt *planner;
-
     try
     {
-        int recursive_run = 0;
-        int failure_count = 0;
-        std::chrono::duration<double> total_duration(0);
-        std::chrono::_V2::system_clock::time_point start_time;
-        start_time = std::chrono::high_resolution_clock::now();
+        auto start_time = std::chrono::high_resolution_clock::now();
+
+        planner = new pibt(COLS, ROWS, starts, goals);
+        planner->record_trajectory = false;
 
-        while (recursive_run < 10)
+        for (int i = 0; i < planner->num_agents; ++i)
         {
-            // Create a new planner instance
-            planner = new pibt(COLS, ROWS, starts, goals);
-            // Run the PIBT algorithm with a timeout
-            planner->timesteps = 0;
-            planner->failed = false; // Reset failure flag
-            planner->run();
-
-            if (planner->failed)
-            {
-                recursive_run += 1;
-                if (recursive_run == 10)
-                {
-                    // failure_count++;
-                    std::cout << "Failed or Timed Out!\n";
-                }
-            }
-            else
-            {
-                planner->SortAgentsById();
-                break;
-            }
+            glm::vec2 InitialPosition = glm::vec2(((float)starts[i][0] * UnitWidth) + UnitWidth / 2 - RADIUS, ((float)starts[i][1] * UnitHeight) + UnitHeight / 2 - RADIUS);
+            glm::vec2 GoalPosition = glm::vec2(((float)goals[i][0] * UnitWidth) + UnitWidth / 2 - RADIUS, ((float)goals[i][1] * UnitHeight) + UnitHeight / 2 - RADIUS);
+            glm::vec3 robotColor = RobotsColors[i];
+            Robots.push_back(new PIBT_Robot(i, InitialPosition, GoalPosition, RADIUS, INITIAL_VELOCITY, ResourceManager::GetTexture("robot"), robotColor, 0.0f, InitialPosition));
+            Robots[i]->Path = {planner->Position(i)};
+            glm::vec2 destination = glm::vec2((float)goals[i][0] * UnitWidth, (float)goals[i][1] * UnitHeight);
+            grid.SetDestinationColor(destination, robotColor);
         }
 
-        std::vector<CostPath> sol;
-
-        // Convert agent path to robot path format
-        for (const Agent *agent : planner->agents)
+        for (int k = 0; k <= PLAN_AHEAD; ++k)
         {
-            std::vector<std::vector<int>> robotPath;
-            for (const auto vertex : agent->Path)
-            {
-                robotPath.push_back({vertex[0], vertex[1], vertex[2]});
-            }
-            sol.push_back(robotPath);
+            PlanStep();
         }
 
-        delete planner;
-
-        auto solution = CleanSolution(sol);
-
         auto end_time = std::chrono::high_resolution_clock::now();
         std::chrono::duration<double> iteration_duration = end_time - start_time;
-        total_duration += iteration_duration;
-
-        path_size = solution[0].size();
-        idle_robots = {};
-        for (int i = 0; i < NUMBER_OF_ROBOTS; ++i)
-        {
-            glm::vec2 InitialPosition = glm::vec2(((float)solution[i].front()[0] * UnitWidth) + UnitWidth / 2 - RADIUS, ((float)solution[i].front()[1] * UnitHeight) + UnitHeight / 2 - RADIUS);
-            glm::vec2 GoalPosition = glm::vec2(((float)solution[i].back()[0] * UnitWidth) + UnitWidth / 2 - RADIUS, ((float)solution[i].back()[1] * UnitHeight) + UnitHeight / 2 - RADIUS);
-            glm::vec3 robotColor = RobotsColors[i];
-            Robots.push_back(new PIBT_Robot(i, InitialPosition, GoalPosition, RADIUS, INITIAL_VELOCITY, ResourceManager::GetTexture("robot"), robotColor, 0.0f, InitialPosition));
-            Robots[i]->Path = solution[i];
-            glm::vec2 destination = glm::vec2((float)solution[i].back()[0] * UnitWidth, (float)solution[i].back()[1] * UnitHeight);
-            grid.SetDestinationColor(destination, robotColor);
-        }
 
         std::cout << "\nDensity (Agents / Number of Cells: " << (float)((NUMBER_OF_ROBOTS / (float)(ROWS * COLS)) * 100) << "%" << std::endl;
         std::cout << "Iteration Time: " << iteration_duration.count() << " seconds" << std::endl;
@@ -157,187 +112,88 @@ void PIBT_Sim::Init()
 
 void PIBT_Sim::Update(float dt)
 {
-    if (StateChanged())
+    if (AllReached() && AllRotated())
     {
-        Replan();
+        // Every robot has finished its step: plan one more and move on
+        PlanStep();
+        globalPathIndex++;
+        for (auto robot : Robots)
+        {
+            robot->isRotating = true;
+            robot->isMoving = false;
+            robot->reached = false;
+        }
     }
-    else
+    for (auto robot : Robots)
     {
-        if (AllReached() && AllRotated())
+        if (globalPathIndex < robot->Path.size())
         {
-            if (globalPathIndex < path_size)
+            robot->currentPathIndex = globalPathIndex;
+            if (robot->isRotating)
             {
-                globalPathIndex++;
-                for (auto robot : Robots)
-                {
-                    robot->isRotating = true;
-                    robot->isMoving = false;
-                    robot->reached = false;
-                }
+                robot->Rotate(dt);
             }
-        }
-        for (auto robot : Robots)
-        {
-            if (globalPathIndex < robot->Path.size())
+            else if (robot->isMoving)
             {
-                robot->currentPathIndex = globalPathIndex;
-                if (robot->isRotating)
-                {
-                    robot->Rotate(dt);
-                }
-                else if (robot->isMoving)
-                {
-                    bool allReached = AllReached();
-                    bool allRotated = AllRotated();
-                    robot->Move(dt, this->UnitWidth, this->UnitHeight, allReached, allRotated);
-                }
+                bool allReached = AllReached();
+                bool allRotated = AllRotated();
+                robot->Move(dt, this->UnitWidth, this->UnitHeight, allReached, allRotated);
             }
-            robot->UpdateStatus();
         }
+        robot->UpdateStatus();
     }
 }
 
-bool PIBT_Sim::StateChanged()
+void PIBT_Sim::PlanStep()
 {
-    for (auto robot : Robots)
+    planner->step();
+    for (int i = 0; i < Robots.size(); ++i)
     {
-        if (robot->status == Status::IDLE)
-            idle_robots.insert(robot->id);
-        else
-            idle_robots.erase(robot->id);
+        Robots[i]->Path.push_back(planner->Position(i));
+        SmoothPathTail(Robots[i]->Path);
     }
-    if (!idle_robots.empty())
-        return true;
-    return false;
+    AssignGoals();
 }
 
-void PIBT_Sim::Replan()
+void PIBT_Sim::AssignGoals()
 {
-    std::cout << "\nREPLANNED!!!\n";
-    std::vector<std::vector<int>> newStarts;
-    for (auto robot : Robots)
-    {
-        if(robot->currentPathIndex < robot->Path.size())
-            newStarts.push_back(robot->Path[robot->currentPathIndex]);
-    }
-    std::vector<std::vector<int>> newGoals = goals;
-    for (auto id : idle_robots)
+    bool changed = false;
+    for (int id = 0; id < Robots.size(); ++id)
     {
+        const std::vector<int> &position = Robots[id]->Path.back();
+        if (position[0] != goals[id][0] || position[1] != goals[id][1])
+            continue;
+
         bool found = false;
         while (!found)
         {
-            bool duplicate = false;
-            std::vector<std::vector<std::vector<int>>> endpoints = GenerateEndpoints(1, ROWS, COLS);
-            for (int i = 0; i < newStarts.size(); i++)
+            std::vector<int> goal = GenerateEndpoints(1, ROWS, COLS)[0][0];
+            found = goal[0] != position[0] || goal[1] != position[1];
+            for (int i = 0; i < goals.size(); i++)
             {
-                if (endpoints[0][0][0] == newStarts[id][0] && endpoints[0][0][1] == newStarts[id][1] ||
-                    endpoints[0][0][0] == newGoals[i][0] && endpoints[0][0][1] == newGoals[i][1])
-                {
-                    duplicate = true;
-                }
-            }
-            if (!duplicate)
-            {
-
-                found = true;
-                newGoals[id] = endpoints[0][0];
+                if (goal[0] == goals[i][0] && goal[1] == goals[i][1])
+                    found = false;
             }
+            if (found)
+                goals[id] = goal;
         }
-    }
-    for (int i = 0; i < newStarts.size(); i++)
-    {
-        std::cout << "New Start: (" << newStarts[i][0] << ", " << newStarts[i][1] << ", " << newStarts[i][2] << ")---" << 
-        "New Gaol: (" << newGoals[i][0] << ", " << newGoals[i][1] << ", " << newGoals[i][2] << ")" << std::endl;
-    }
 
-        goals = newGoals;
+        planner->setGoal(id, goals[id][0], goals[id][1]);
+        Robots[id]->GoalPosition = glm::vec2(((float)goals[id][0] * UnitWidth) + UnitWidth / 2 - RADIUS,
+                                             ((float)goals[id][1] * UnitHeight) + UnitHeight / 2 - RADIUS);
+        std::cout << "New Goal for " << id << ": (" << goals[id][0] << ", " << goals[id][1] << ")" << std::endl;
+        changed = true;
+    }
 
-    idle_robots.clear();
+    if (!changed)
+        return;
 
+    // Reload the grid to clear old destination colors
     grid.Load("resources/levels/6x6.lvl", this->Width, this->Height);
-
-    pibt *planner;
-
-    try
+    for (int i = 0; i < goals.size(); i++)
     {
-        int recursive_run = 0;
-        int failure_count = 0;
-        std::chrono::duration<double> total_duration(0);
-        std::chrono::_V2::system_clock::time_point start_time;
-        start_time = std::chrono::high_resolution_clock::now();
-
-        while (recursive_run < 10)
-        {
-            planner = new pibt(COLS, ROWS, newStarts, newGoals);
-            planner->timesteps = 0;
-            planner->failed = false;
-            planner->run();
-
-            if (planner->failed)
-            {
-                recursive_run += 1;
-                if (recursive_run == 10)
-                {
-                    std::cout << "Failed or Timed Out!\n";
-                }
-            }
-            else
-            {
-                planner->SortAgentsById();
-                break;
-            }
-        }
-
-        std::vector<CostPath> sol;
-        for (const Agent *agent : planner->agents)
-        {
-            std::vector<std::vector<int>> robotPath;
-            for (const auto vertex : agent->Path)
-            {
-                robotPath.push_back({vertex[0], vertex[1], vertex[2]});
-            }
-            sol.push_back(robotPath);
-        }
-
-        delete planner;
-        globalPathIndex = 1;
-
-        auto solution = CleanSolution(sol);
-
-        auto end_time = std::chrono::high_resolution_clock::now();
-        std::chrono::duration<double> iteration_duration = end_time - start_time;
-        total_duration += iteration_duration;
-        path_size = solution[0].size();
-
-        std::vector<float> current_rotations;
-        std::vector<glm::vec2> current_positions;
-        for (auto robot : Robots)
-        {
-            current_rotations.push_back(robot->CurrentRotation);
-            current_positions.push_back(robot->CurrentPosition);
-        }
-
-        Robots.clear();
-        for (int i = 0; i < NUMBER_OF_ROBOTS; ++i)
-        {
-            glm::vec2 InitialPosition = glm::vec2(((float)newStarts[i][0] * UnitWidth) + UnitWidth / 2 - RADIUS,
-                                                  ((float)newStarts[i][1] * UnitHeight) + UnitHeight / 2 - RADIUS);
-            glm::vec2 GoalPosition = glm::vec2(((float)newGoals[i][0] * UnitWidth) + UnitWidth / 2 - RADIUS,
-                                               ((float)newGoals[i][1] * UnitHeight) + UnitHeight / 2 - RADIUS);
-            glm::vec2 destination = glm::vec2((float)newGoals[i][0] * UnitWidth, (float)newGoals[i][1] * UnitHeight);
-            glm::vec3 robotColor = RobotsColors[i];
-            Robots.push_back(new PIBT_Robot(i, InitialPosition, GoalPosition, RADIUS, INITIAL_VELOCITY,
-                                       ResourceManager::GetTexture("robot"), robotColor, current_rotations[i], InitialPosition));
-            Robots[i]->Path = solution[i];
-            grid.SetDestinationColor(destination, robotColor);
-        }
-
-        std::cout << "\nDensity (Agents / Number of Cells: " << (float)((NUMBER_OF_ROBOTS / (float)(ROWS * COLS)) * 100) << "%" << std::endl;
-        std::cout << "Iteration Time: " << iteration_duration.count() << " seconds" << std::endl;
-    }
-    catch (const std::exception &e)
-    {
-        std::cerr << "Error: " << e.what() << '\n';
+        glm::vec2 destination = glm::vec2((float)goals[i][0] * UnitWidth, (float)goals[i][1] * UnitHeight);
+        grid.SetDestinationColor(destination, RobotsColors[i]);
     }
 }
 
@@ -383,28 +239,22 @@ void PIBT_Sim::Render()
     }
 }
 
-std::vector<std::vector<std::vector<int>>> PIBT_Sim::CleanSolution(const std::vector<std::vector<std::vector<int>>> &sol)
+// Smooths the step before the newest one: a robot that steps out and straight
+// back waits in place instead, and keeps the heading it turns to anyway
+void PIBT_Sim::SmoothPathTail(std::vector<std::vector<int>> &path)
 {
+    int i = (int)path.size() - 3;
+    if (i < 0)
+        return;
 
-    std::vector<std::vector<std::vector<int>>> solution = sol;
-
-    int max_length = solution[0].size();
-
-    for (int k = 0; k < solution.size(); k++)
+    if (path[i][0] == path[i + 2][0] && path[i][1] == path[i + 2][1])
     {
-        for (int i = 0; i + 2 < max_length; i++)
-        {
-            if (solution[k][i][0] == solution[k][i + 2][0] && solution[k][i][1] == solution[k][i + 2][1])
-            {
-                solution[k][i + 1][0] = solution[k][i + 2][0];
-                solution[k][i + 1][1] = solution[k][i + 2][1];
-                solution[k][i + 1][2] = solution[k][i + 2][2];
-            }
-            if (solution[k][i][2] == solution[k][i + 2][2])
-            {
-                solution[k][i + 1][2] = solution[k][i + 2][2];
-            }
-        }
+        path[i + 1][0] = path[i + 2][0];
+        path[i + 1][1] = path[i + 2][1];
+        path[i + 1][2] = path[i + 2][2];
+    }
+    if (path[i][2] == path[i + 2][2])
+    {
+        path[i + 1][2] = path[i + 2][2];
     }
-    return solution;
 }